@@ -0,0 +1,75 @@
+#include "alloc_audit.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+
+#include <execinfo.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t max_reported = 32;
+    constexpr int max_backtrace_depth = 24;
+
+    std::atomic<bool> active(false);
+    std::atomic<size_t> allocations(0);
+    thread_local bool reporting = false;
+}
+
+bool sg::detail::alloc_hooks_linked = false;
+
+// a frame of its own under malloc() and the like, for the backtrace
+[[gnu::noinline]] void sg::detail::note_allocation(size_t size)
+{
+    if (!active.load(std::memory_order_relaxed))
+        return;
+    // backtrace() and the output must not recurse into the audit
+    if (reporting)
+        return;
+    reporting = true;
+
+    size_t n = allocations.fetch_add(1, std::memory_order_relaxed);
+    if (n < max_reported)
+    {
+        char header[96];
+        int len = std::snprintf(header, sizeof header,
+                                "sg: heap allocation #%zu of %zu bytes after warm-up\n",
+                                n + 1, size);
+        if (write(STDERR_FILENO, header, len) == len)
+        {
+            void* frames[max_backtrace_depth];
+            int depth = backtrace(frames, max_backtrace_depth);
+            // skips note_allocation() and malloc() or the like
+            if (depth > 2)
+                backtrace_symbols_fd(frames + 2, depth - 2, STDERR_FILENO);
+        }
+    }
+
+    reporting = false;
+}
+
+bool sg::alloc_audit_linked()
+{
+    return detail::alloc_hooks_linked;
+}
+
+void sg::start_alloc_audit()
+{
+    // the first backtrace() loads libgcc and allocates
+    void* frames[1];
+    backtrace(frames, 1);
+
+    allocations.store(0, std::memory_order_relaxed);
+    active.store(true, std::memory_order_relaxed);
+}
+
+void sg::stop_alloc_audit()
+{
+    active.store(false, std::memory_order_relaxed);
+}
+
+size_t sg::audited_allocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
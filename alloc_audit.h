@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+namespace sg
+{
+    // An executable that links the sg_alloc_audit object library replaces
+    // malloc(), calloc(), realloc() and the aligned allocation functions
+    // of the C library; sg_bench does, the demos with -DSG_ALLOC_AUDIT=ON.
+    // While the audit is started every call of them is counted, whether
+    // from operator new or from a C library such as cairo, and the first
+    // ones are reported with a backtrace on stderr. Without the hooks
+    // nothing is counted.
+    void start_alloc_audit();
+    void stop_alloc_audit();
+    size_t audited_allocations();
+    bool alloc_audit_linked();
+
+    namespace detail
+    {
+        // set by the hooks, called by them for every allocation
+        extern bool alloc_hooks_linked;
+        void note_allocation(size_t size);
+    }
+}
@@ -0,0 +1,85 @@
+#include "alloc_audit.h"
+
+#include <cerrno>
+#include <cstddef>
+
+// Only in executables that link sg_alloc_audit. A sanitizer brings its
+// own malloc(), which these must not replace; the audit sees nothing
+// then.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define SG_ALLOC_HOOKS 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define SG_ALLOC_HOOKS 0
+#endif
+#endif
+#ifndef SG_ALLOC_HOOKS
+#define SG_ALLOC_HOOKS 1
+#endif
+
+#if SG_ALLOC_HOOKS
+namespace
+{
+    struct hooks_linked
+    {
+        hooks_linked()
+        {
+            sg::detail::alloc_hooks_linked = true;
+        }
+    } linked;
+}
+
+// The allocation functions of glibc under their own names, the ones below
+// replace the public names for the whole process: C libraries such as
+// cairo and libstdc++'s operator new allocate through them.
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+
+    void* malloc(size_t size)
+    {
+        sg::detail::note_allocation(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        sg::detail::note_allocation(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size)
+    {
+        sg::detail::note_allocation(size);
+        return __libc_realloc(p, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        sg::detail::note_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        sg::detail::note_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** p, size_t alignment, size_t size)
+    {
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        sg::detail::note_allocation(size);
+        void* result = __libc_memalign(alignment, size);
+        if (!result && size != 0)
+            return ENOMEM;
+        *p = result;
+        return 0;
+    }
+}
+#endif
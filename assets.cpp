@@ -0,0 +1,380 @@
+#include "assets.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iterator>
+
+#include <cairo-gl.h>
+
+using namespace sg;
+
+struct image::entry
+{
+    enum class state
+    {
+        waiting,  // for memory below the cap
+        decoding, // queued for or on a loader thread
+        decoded,  // waiting for upload
+        ready,
+        failed,
+    };
+
+    assets* owner;
+    std::string path;
+    state st;
+    size_t refs;
+    uint64_t released; // owner->release_clock when refs dropped to 0
+    size_t bytes;
+    // counted in assets::reserved while decoding
+    size_t reserved;
+    // set by a loader thread, handed over under assets::mutex
+    cairo_surface_t* decoded_image;
+    cairo_surface_t* surface;
+    int width;
+    int height;
+};
+
+image::image()
+    : e(nullptr)
+{}
+
+image::image(entry* e)
+    : e(e)
+{
+    ++e->refs;
+}
+
+image::image(image const& other)
+    : e(other.e)
+{
+    if (e)
+        ++e->refs;
+}
+
+image::image(image&& other)
+    : e(other.e)
+{
+    other.e = nullptr;
+}
+
+image& image::operator=(image other)
+{
+    std::swap(e, other.e);
+    return *this;
+}
+
+image::~image()
+{
+    // assets keeps the entry, see assets::evict()
+    if (e && --e->refs == 0)
+        e->released = ++e->owner->release_clock;
+}
+
+image::operator bool() const
+{
+    return e != nullptr;
+}
+
+bool image::ready() const
+{
+    return e && e->st == entry::state::ready;
+}
+
+bool image::failed() const
+{
+    return e && e->st == entry::state::failed;
+}
+
+cairo_surface_t* image::surface() const
+{
+    return ready() ? e->surface : nullptr;
+}
+
+int image::width() const
+{
+    return ready() ? e->width : 0;
+}
+
+int image::height() const
+{
+    return ready() ? e->height : 0;
+}
+
+assets::assets(cairo_device_t* device, size_t memory_cap, size_t threads)
+    : device(device)
+    , memory_cap(memory_cap)
+    , memory(0)
+    , reserved(0)
+    , release_clock(0)
+    , pending_(0)
+    , thread_count(std::max<size_t>(threads, 1))
+    , stopping(false)
+{}
+
+assets::~assets()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads)
+        t.join();
+
+    for (std::pair<std::string const, std::unique_ptr<image::entry>>& p : entries)
+    {
+        image::entry& e = *p.second;
+        assert(e.refs == 0);
+        if (e.decoded_image)
+            cairo_surface_destroy(e.decoded_image);
+        if (e.surface)
+            cairo_surface_destroy(e.surface);
+    }
+}
+
+image assets::load(std::string const& path)
+{
+    std::unique_ptr<image::entry>& slot = entries[path];
+    if (slot)
+    {
+        // a failed load is retried once nobody holds the old handle
+        if (slot->st == image::entry::state::failed && slot->refs == 0)
+        {
+            slot->st = image::entry::state::waiting;
+            ++pending_;
+            waiting.push_back(slot.get());
+            start_decodes();
+        }
+        return image(slot.get());
+    }
+
+    slot = std::make_unique<image::entry>();
+    image::entry& e = *slot;
+    e.owner = this;
+    e.path = path;
+    e.st = image::entry::state::waiting;
+    e.refs = 0;
+    e.released = 0;
+    e.bytes = 0;
+    e.reserved = 0;
+    e.decoded_image = nullptr;
+    e.surface = nullptr;
+    e.width = 0;
+    e.height = 0;
+
+    ++pending_;
+    waiting.push_back(&e);
+    start_decodes();
+    return image(&e);
+}
+
+void assets::update(duration budget)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<image::entry*> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(decoded);
+    }
+
+    for (image::entry* e : done)
+    {
+        reserved -= e->reserved;
+        e->reserved = 0;
+        if (!e->decoded_image)
+        {
+            e->st = image::entry::state::failed;
+            --pending_;
+            continue;
+        }
+
+        e->width = cairo_image_surface_get_width(e->decoded_image);
+        e->height = cairo_image_surface_get_height(e->decoded_image);
+        e->bytes = static_cast<size_t>(cairo_image_surface_get_stride(e->decoded_image)) * e->height;
+        memory += e->bytes;
+        e->st = image::entry::state::decoded;
+        to_upload.push_back(e);
+    }
+
+    // at least one per frame, so that a tiny budget still makes progress
+    while (!to_upload.empty())
+    {
+        image::entry* e = to_upload.front();
+        to_upload.pop_front();
+        upload(*e);
+
+        if (std::chrono::steady_clock::now() - start >= budget)
+            break;
+    }
+
+    while (memory > memory_cap && evict())
+    {}
+
+    start_decodes();
+}
+
+size_t assets::memory_used() const
+{
+    return memory;
+}
+
+size_t assets::pending() const
+{
+    return pending_;
+}
+
+namespace
+{
+    // bytes of the image surface a PNG decodes into, from the size in its
+    // IHDR chunk; 0 if the file is not a PNG, the decode fails then
+    size_t decoded_size(std::string const& path)
+    {
+        static unsigned char const signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f)
+            return 0;
+        // signature, chunk length, "IHDR", width, height
+        unsigned char header[24];
+        size_t read = std::fread(header, 1, sizeof header, f);
+        std::fclose(f);
+        if (read != sizeof header
+         || !std::equal(std::begin(signature), std::end(signature), header)
+         || !std::equal(header + 12, header + 16, "IHDR"))
+            return 0;
+
+        auto big_endian = [](unsigned char const* p)
+        {
+            return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        };
+        uint32_t width = big_endian(header + 16);
+        uint32_t height = big_endian(header + 20);
+        // larger than cairo's limit, the decode fails
+        if (width > 32767 || height > 32767)
+            return 0;
+        return static_cast<size_t>(cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width)) * height;
+    }
+}
+
+void assets::start_decodes()
+{
+    // decodes under way count with the size of what they decode into
+    while (!waiting.empty() && (memory + reserved < memory_cap || evict()))
+    {
+        image::entry* e = waiting.front();
+        waiting.pop_front();
+        e->st = image::entry::state::decoding;
+        e->reserved = decoded_size(e->path);
+        reserved += e->reserved;
+
+        // started with the first load, a model without images has none
+        if (threads.empty())
+            for (size_t i = 0; i != thread_count; ++i)
+                threads.emplace_back([this] { decode_main(); });
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            to_decode.push_back(e);
+        }
+        wake.notify_one();
+    }
+}
+
+bool assets::evict()
+{
+    // the image released longest ago, failed loads go along
+    std::map<std::string, std::unique_ptr<image::entry>>::iterator victim = entries.end();
+    for (std::map<std::string, std::unique_ptr<image::entry>>::iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        image::entry& e = *i->second;
+        if (e.refs != 0
+         || (e.st != image::entry::state::ready && e.st != image::entry::state::failed))
+            continue;
+        if (victim == entries.end() || e.released < victim->second->released)
+            victim = i;
+    }
+
+    if (victim == entries.end())
+        return false;
+
+    memory -= victim->second->bytes;
+    if (victim->second->surface)
+        cairo_surface_destroy(victim->second->surface);
+    entries.erase(victim);
+    return true;
+}
+
+void assets::upload(image::entry& e)
+{
+    if (!device)
+    {
+        e.surface = e.decoded_image;
+        e.decoded_image = nullptr;
+        e.st = image::entry::state::ready;
+        --pending_;
+        return;
+    }
+
+    // requires the cairo context to be current, as in sg::run before draw
+    cairo_surface_t* s = cairo_gl_surface_create(device, CAIRO_CONTENT_COLOR_ALPHA, e.width, e.height);
+    if (cairo_surface_status(s) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(s);
+        cairo_surface_destroy(e.decoded_image);
+        e.decoded_image = nullptr;
+        memory -= e.bytes;
+        e.bytes = 0;
+        e.st = image::entry::state::failed;
+        --pending_;
+        return;
+    }
+
+    cairo_t* cr = cairo_create(s);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, e.decoded_image, 0., 0.);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(s);
+
+    // a texture of the same size replaces the pixels in memory
+    cairo_surface_destroy(e.decoded_image);
+    e.decoded_image = nullptr;
+    memory -= e.bytes;
+    e.bytes = static_cast<size_t>(e.width) * e.height * 4;
+    memory += e.bytes;
+    e.surface = s;
+    e.st = image::entry::state::ready;
+    --pending_;
+}
+
+void assets::decode_main()
+{
+    for (;;)
+    {
+        image::entry* e;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !to_decode.empty(); });
+            if (stopping)
+                return;
+
+            e = to_decode.front();
+            to_decode.pop_front();
+        }
+
+        // image surfaces are not tied to a GL context, any thread can
+        // create them
+        cairo_surface_t* s = cairo_image_surface_create_from_png(e->path.c_str());
+        if (cairo_surface_status(s) != CAIRO_STATUS_SUCCESS)
+        {
+            cairo_surface_destroy(s);
+            s = nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        e->decoded_image = s;
+        decoded.push_back(e);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cairo.h>
+
+namespace sg
+{
+    struct assets;
+
+    // Reference counted handle to an image loaded by sg::assets. Not
+    // ready() until decoded and uploaded; use it from the model's thread
+    // only, and not after the assets it came from are gone.
+    struct image
+    {
+        image();
+        image(image const& other);
+        image(image&& other);
+        image& operator=(image other);
+        ~image();
+
+        explicit operator bool() const;
+        bool ready() const;
+        bool failed() const;
+
+        // nullptr until ready(); a cairo-gl surface under sg::run, an image
+        // surface under sg::headless
+        cairo_surface_t* surface() const;
+        int width() const;
+        int height() const;
+
+    private:
+        struct entry;
+
+        explicit image(entry* e);
+
+        entry* e;
+
+        friend struct assets;
+    };
+
+    // Loads PNG files without blocking the frame loop.
+    //
+    // load() returns at once; files are decoded into cairo image surfaces
+    // on background threads. update(), called by sg::run before every
+    // frame, picks up finished decodes and uploads them to the GPU, as many
+    // as fit into its time budget (at least one per frame). The same path
+    // loads once while it is referenced.
+    //
+    // Images nobody references any more stay cached and are evicted least
+    // recently released first once the memory in use exceeds the cap. A
+    // decode starts only while the memory in use and the decodes under way,
+    // sized by the PNG headers, are below the cap, so the last one may
+    // overshoot it; while referenced images alone exceed it, new decodes
+    // wait. The header is read on the calling thread.
+    struct assets
+    {
+        typedef std::chrono::microseconds duration;
+
+        // device nullptr keeps decoded image surfaces as they are, the
+        // loader threads start with the first load()
+        assets(cairo_device_t* device, size_t memory_cap, size_t threads);
+
+        assets(assets const&) = delete;
+        assets& operator=(assets const&) = delete;
+
+        ~assets();
+
+        image load(std::string const& path);
+
+        void update(duration budget);
+
+        // bytes of pixels held, decoded or uploaded
+        size_t memory_used() const;
+        // loads that are not ready and did not fail yet
+        size_t pending() const;
+
+    private:
+        void start_decodes();
+        bool evict();
+        void upload(image::entry& e);
+        void decode_main();
+
+    private:
+        cairo_device_t* device;
+        size_t memory_cap;
+        size_t memory;
+        // decoded size of the images being decoded
+        size_t reserved;
+        uint64_t release_clock;
+        size_t pending_;
+        size_t thread_count;
+
+        std::map<std::string, std::unique_ptr<image::entry>> entries;
+        // requested, waiting for memory below the cap
+        std::deque<image::entry*> waiting;
+        // decoded, waiting for upload
+        std::deque<image::entry*> to_upload;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<image::entry*> to_decode;
+        std::vector<image::entry*> decoded;
+        bool stopping;
+        std::vector<std::thread> threads;
+
+        friend struct image;
+    };
+}
@@ -0,0 +1,1190 @@
+#pragma once
+
+#include "simple_game_window.h"
+#include "camera.h"
+#include "ecs.h"
+#include "frame_stats.h"
+#include "kernels.h"
+#include "particles.h"
+#include "snapshot.h"
+#include "spatial_grid.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+struct point
+{
+    constexpr point()
+        : x(0)
+        , y(0)
+    {}
+
+    constexpr point(double x, double y)
+        : x(x)
+        , y(y)
+    {}
+
+    double x;
+    double y;
+};
+
+inline point operator+(point a, point b)
+{
+    return point(a.x + b.x, a.y + b.y);
+}
+
+inline point operator-(point a, point b)
+{
+    return point(a.x - b.x, a.y - b.y);
+}
+
+inline point operator*(point a, double b)
+{
+    return point(a.x * b, a.y * b);
+}
+
+inline point operator*(double a, point b)
+{
+    return point(a * b.x, a * b.y);
+}
+
+inline double dot(point a, point b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+inline double norm2(point a)
+{
+    return a.x * a.x + a.y * a.y;
+}
+
+inline double norm(point a)
+{
+    return hypot(a.x, a.y);
+}
+
+inline double distance2(point a, point b)
+{
+    return norm2(a - b);
+}
+
+inline double distance(point a, point b)
+{
+    return norm(a - b);
+}
+
+// Earliest t in [0, 1] at which a point going from p to p + d comes
+// within r of the origin, 0 if it starts there, negative if it never
+// does.
+inline double sweep(point p, point d, double r)
+{
+    double c = norm2(p) - r * r;
+    if (c <= 0)
+        return 0.;
+
+    double a = norm2(d);
+    double b = dot(p, d);
+    // standing still or moving away
+    if (a == 0 || b >= 0)
+        return -1.;
+
+    double disc = b * b - a * c;
+    if (disc < 0)
+        return -1.;
+
+    double t = (-b - sqrt(disc)) / a;
+    return t <= 1. ? t : -1.;
+}
+
+// lengths and speeds in screens, a screen being 1 / world_screens of
+// the torus
+constexpr double asteroid_sizes[3] = {0.016, 0.029, 0.053};
+constexpr double bullet_radius = 0.007;
+constexpr double line_width = 0.0025;
+
+constexpr point ship_p1(0.1/3.5, 0.);
+constexpr point ship_p2(-0.1/3.5, 0.07/3.5);
+constexpr point ship_p3(-0.1/3.5, -0.07/3.5);
+constexpr double collision_tolerance = 0.003;
+// bounds ship_p1, ship_p2 and ship_p3
+constexpr double ship_radius = 0.035;
+constexpr std::chrono::milliseconds reload_time(200);
+
+struct asteroids_model : sg::model
+{
+    enum class ship_rotation
+    {
+        none,
+        left,
+        right,
+    };
+
+    // how bullets find the asteroids they hit
+    enum class bullet_test
+    {
+        // where the bullet is at the end of the step: a long frame lets a
+        // bullet jump over a small asteroid, unless substeps shorten it
+        discrete,
+        // along the path of the bullet relative to the asteroid over the
+        // step, earliest hits first; steps must stay shorter than half
+        // the field
+        swept,
+    };
+
+    struct settings
+    {
+        settings()
+            : test(bullet_test::discrete)
+            , substeps(1)
+            , stress_asteroids(0)
+            , fire_interval(reload_time)
+            , log_interval(0)
+            , world_screens(1.)
+            , history(default_history)
+        {}
+
+        static constexpr size_t default_history = SIZE_MAX;
+
+        bullet_test test;
+        // splits every frame into as many simulation steps
+        uint32_t substeps;
+        // 0 is the game. Otherwise new big asteroids keep the field at
+        // this count, and the ship flies and fires by itself and cannot
+        // die: a load that holds for hours
+        size_t stress_asteroids;
+        // between two shots while firing
+        std::chrono::milliseconds fire_interval;
+        // model time between two soak report lines on std::clog, 0 for
+        // none
+        std::chrono::milliseconds log_interval;
+        // screens across the field, the view following the ship above 1;
+        // a wave is three big asteroids per screen
+        double world_screens;
+        // ticks kept for rewind and late inputs, 0 for none; by default
+        // 600 in the game and none under stress, where the snapshot ring
+        // would take up to 64 MB of what a soak run measures
+        size_t history;
+    };
+
+    // components, asteroids are (position, velocity, asteroid) and bullets
+    // are (position, velocity, bullet) entities
+    struct position : point
+    {
+        using point::point;
+    };
+
+    struct velocity : point
+    {
+        using point::point;
+    };
+
+    struct asteroid
+    {
+        int size;
+        int health;
+    };
+
+    // ttl is aged in one pass over the bullet column; a timer per bullet
+    // would cost a callback and a cancel when the bullet hits something
+    struct bullet
+    {
+        double ttl;
+    };
+
+    asteroids_model(sg::context& ctx)
+        : asteroids_model(ctx, settings())
+    {}
+
+    asteroids_model(sg::context& ctx, settings const& config)
+        : model(ctx)
+        , config(config)
+        , unit(1. / std::max(config.world_screens, 1.))
+        , dead(false)
+        , ship(0.5, 0.5)
+        , ship_yaw(2. * 3.1415 * ctx.random().uniform())
+        , ship_rot(ship_rotation::none)
+        , engine_enabled(false)
+        , shooting_enabled(false)
+        , next_shot(0)
+        // the widest query, the ship against a big asteroid, stays
+        // within 3x3 cells
+        , bullet_grid((asteroid_sizes[2] + ship_radius) * unit)
+        , asteroid_grid((asteroid_sizes[2] + ship_radius) * unit)
+        // a query around the view visits about 6x6 cells
+        , sprites(0.25 * unit)
+        // cosmetic, a seed of their own leaves ctx.random() to the game
+        , explosions(65536, 1)
+        , exhaust(8192, 2)
+        , asteroid_count(ctx.counter("asteroids"))
+        , bullet_count(ctx.counter("bullets"))
+        , particle_count(ctx.counter("particles"))
+        , particles_dropped(ctx.counter("particles dropped"))
+        , model_time(0)
+        , tick(0)
+        // a tick moves every entity, most of a row of the columns
+        , snapshots(history_ticks(config), std::min<size_t>(history_ticks(config) * (256 + 32 * (asteroid_room(config) + bullet_room(config))),
+                                                            64 << 20))
+        , frame_times(history_ticks(config) + 1, 0)
+        , resimulating(false)
+        , next_log(config.log_interval.count())
+        , log_frames(0)
+    {
+        using sg::ecs::components;
+
+        this->config.substeps = std::max<uint32_t>(config.substeps, 1);
+        this->config.fire_interval = std::max(config.fire_interval, std::chrono::milliseconds(1));
+        this->config.world_screens = 1. / unit;
+        this->config.history = history_ticks(config);
+
+        size_t asteroids = asteroid_room(config);
+        size_t bullets = bullet_room(config);
+        world.reserve<position, velocity, asteroid>(asteroids);
+        world.reserve<position, velocity, bullet>(bullets);
+        bullet_grid.reserve(bullets);
+        bullet_hits.reserve(asteroids);
+        expired.reserve(bullets);
+        candidates.reserve(32);
+        candidate_x.reserve(32);
+        candidate_y.reserve(32);
+        candidate_r.reserve(32);
+        hits.reserve(32);
+        asteroid_grid.reserve(asteroids);
+        sprites.reserve(asteroids + bullets);
+        if (config.log_interval.count() != 0)
+        {
+            frame_ms.reserve(4096);
+            update_ms.reserve(4096);
+            draw_ms.reserve(4096);
+        }
+
+        // move and age_bullets touch disjoint components and share a stage
+        systems.add("move", {components<velocity>(), components<position>()},
+                    [this](sg::ecs::registry& r) { move(r); });
+        systems.add("age_bullets", {0, components<bullet>()},
+                    [this](sg::ecs::registry& r) { age_bullets(r); });
+        systems.add("collide", {components<position, velocity>(), components<asteroid, bullet>()},
+                    [this](sg::ecs::registry& r) { collisions(r); });
+
+        // all update() depends on besides the inputs; the particles are
+        // for show and start over
+        if (this->config.history != 0)
+        {
+            inputs.reserve(64);
+            snapshots.add([this] { return world.state_size(); },
+                          [this](unsigned char* out) { world.save_state(out); },
+                          [this](unsigned char const* in, size_t size) { world.load_state(in, size); });
+            snapshots.add(ctx.random());
+            snapshots.add(dead);
+            snapshots.add(ship);
+            snapshots.add(ship_velocity);
+            snapshots.add(ship_yaw);
+            snapshots.add(ship_rot);
+            snapshots.add(engine_enabled);
+            snapshots.add(shooting_enabled);
+            snapshots.add(next_shot);
+            snapshots.add(model_time);
+            snapshots.save(tick);
+        }
+    }
+
+    static size_t history_ticks(settings const& config)
+    {
+        if (config.history != settings::default_history)
+            return config.history;
+        return config.stress_asteroids == 0 ? 600 : 0;
+    }
+
+    // Three big asteroids per screen break into at most 27 pieces, a
+    // bullet lives for four shot intervals: no allocation in game. Under
+    // stress the field holds about twice its big asteroids in fragments.
+    static size_t asteroid_room(settings const& config)
+    {
+        size_t screens = std::max<long>(1, std::lround(config.world_screens * config.world_screens));
+        return std::max<size_t>(32 * screens, 2 * config.stress_asteroids);
+    }
+
+    static size_t bullet_room(settings const& config)
+    {
+        size_t fire_interval = std::max<int64_t>(1, config.fire_interval.count());
+        return std::max<size_t>(8, 1000 / fire_interval + 1);
+    }
+
+    // The ship hull, turned once per frame, against the asteroids the grid
+    // has around it, in ship space. A bounding circle test leaves few
+    // candidates, the kernel checks their distance to the hull edges.
+    asteroid* ship_hit(sg::spatial_grid<asteroid*> const& grid)
+    {
+        point mx(cos(ship_yaw), sin(ship_yaw));
+        point my(sin(ship_yaw), -cos(ship_yaw));
+        double hull_x[3] = {dot(mx, ship_p1) * unit, dot(mx, ship_p2) * unit, dot(mx, ship_p3) * unit};
+        double hull_y[3] = {dot(my, ship_p1) * unit, dot(my, ship_p2) * unit, dot(my, ship_p3) * unit};
+        double radius = ship_radius * unit;
+
+        candidates.clear();
+        candidate_x.clear();
+        candidate_y.clear();
+        candidate_r.clear();
+        grid.query(ship.x, ship.y, asteroid_sizes[2] * unit + radius, [&](asteroid* e, double dx, double dy)
+        {
+            double r = (asteroid_sizes[e->size] - collision_tolerance) * unit;
+            if (e->health != 0 && dx * dx + dy * dy < (radius + r) * (radius + r))
+            {
+                candidates.push_back(e);
+                candidate_x.push_back(dx);
+                candidate_y.push_back(dy);
+                candidate_r.push_back(r);
+            }
+            return true;
+        });
+        if (candidates.empty())
+            return nullptr;
+
+        // the first candidate hit is the one the grid visited first
+        hits.resize(candidates.size());
+        size_t count = sg::kernels().polygon_hits(hull_x, hull_y, 3,
+                                                  candidate_x.data(), candidate_y.data(), candidate_r.data(),
+                                                  candidates.size(), hits.data());
+        return count != 0 ? candidates[hits[0]] : nullptr;
+    }
+
+    // the shots due by model_time, one every fire_interval while shooting
+    // is enabled; in model time rather than on a timer, so that a
+    // snapshot holds the reload
+    void shoot()
+    {
+        if (dead || !shooting_enabled)
+            return;
+
+        // the first shot after a pause goes right away
+        next_shot = std::max(next_shot, model_time);
+        for (; next_shot <= model_time; next_shot += config.fire_interval.count())
+        {
+            world.create(position(ship.x + 0.1/3.5 * unit * cos(ship_yaw),
+                                  ship.y + 0.1/3.5 * unit * sin(ship_yaw)),
+                         velocity(ship_velocity.x + 10. * unit * cos(ship_yaw),
+                                  ship_velocity.y + 10. * unit * sin(ship_yaw)),
+                         bullet{0.8});
+        }
+    }
+
+    // asteroids and bullets alike; a column of (x, y) pairs is one array
+    // of doubles to the kernel, x and y move the same way
+    void move(sg::ecs::registry& r)
+    {
+        static_assert(std::is_standard_layout_v<position> && std::is_standard_layout_v<velocity>);
+        static_assert(sizeof(position) == 2 * sizeof(double) && sizeof(velocity) == 2 * sizeof(double));
+        static_assert(offsetof(position, y) == sizeof(double) && offsetof(velocity, y) == sizeof(double));
+
+        double k = step_time * 0.0001;
+        sg::kernel_set const& kernels = sg::kernels();
+        r.each_chunk<position, velocity>([k, &kernels](size_t n, sg::ecs::entity const*, position* pos, velocity const* v)
+        {
+            kernels.integrate_wrap(reinterpret_cast<double*>(pos), reinterpret_cast<double const*>(v), 2 * n, k);
+        });
+    }
+
+    // commit() compacts the columns over the destroyed bullets
+    void age_bullets(sg::ecs::registry& r)
+    {
+        static_assert(sizeof(bullet) == sizeof(double));
+
+        double dt = step_time * 0.001;
+        sg::kernel_set const& kernels = sg::kernels();
+        r.each_chunk<bullet>([this, &r, dt, &kernels](size_t n, sg::ecs::entity const* ids, bullet* b)
+        {
+            // grows with the bullet count only
+            if (expired.size() < n)
+                expired.resize(n);
+
+            size_t count = kernels.expire(&b->ttl, n, dt, expired.data());
+            for (size_t i = 0; i != count; ++i)
+                r.destroy(ids[expired[i]]);
+        });
+    }
+
+    // A bullet is destroyed at commit(), one that expired or hit something
+    // in this step is marked by its ttl so that it hits nothing else.
+    static bool spent(bullet const& b)
+    {
+        return b.ttl < 0.;
+    }
+
+    static void spend(sg::ecs::registry& r, sg::ecs::entity id, bullet& b)
+    {
+        b.ttl = -1.;
+        r.destroy(id);
+    }
+
+    // bullets against asteroids, then the ship against what is left;
+    // bullets keep hitting after the ship is gone
+    void collisions(sg::ecs::registry& r)
+    {
+        double k = step_time * 0.0001;
+        // the farthest a bullet went in this step
+        double bullet_step = 0.;
+        bullet_grid.clear();
+        r.each_chunk<position, velocity, bullet>([&](size_t n, sg::ecs::entity const* ids,
+                                                     position const* pos, velocity const* v, bullet* b)
+        {
+            for (size_t i = 0; i != n; ++i)
+            {
+                bullet_grid.insert(pos[i].x, pos[i].y, bullet_ref{ids[i], v[i], &b[i]});
+                if (config.test == bullet_test::swept)
+                    bullet_step = std::max(bullet_step, norm(v[i]) * k);
+            }
+        });
+        bullet_grid.build();
+
+        bullet_hits.clear();
+        r.each<position, velocity, asteroid>([&](sg::ecs::entity, position const& pos, velocity const& v, asteroid& e)
+        {
+            // the one that hit the ship breaks up in this step
+            if (e.health == 0)
+                return;
+
+            double reach = (asteroid_sizes[e.size] + line_width + bullet_radius) * unit;
+            if (config.test == bullet_test::discrete)
+            {
+                // one bullet per asteroid and step
+                bullet_grid.query(pos.x, pos.y, reach, [&](bullet_ref const& b, double dx, double dy)
+                {
+                    if (spent(*b.state) || dx * dx + dy * dy >= reach * reach)
+                        return true;
+
+                    spend(r, b.id, *b.state);
+                    --e.health;
+                    return false;
+                });
+                return;
+            }
+
+            // a bullet ending farther away than both steps cannot have
+            // come within reach
+            double asteroid_step = norm(v) * k;
+            bullet_grid.query(pos.x, pos.y, reach + bullet_step + asteroid_step, [&](bullet_ref const& b, double dx, double dy)
+            {
+                // relative to the asteroid the bullet went from (dx, dy) - d
+                // to (dx, dy)
+                point d = (b.v - v) * k;
+                double t = sweep(point(dx, dy) - d, d, reach);
+                if (t >= 0.)
+                    bullet_hits.push_back(bullet_hit{t, static_cast<uint32_t>(bullet_hits.size()), b.id, b.state, &e});
+                return true;
+            });
+        });
+
+        if (config.test == bullet_test::swept)
+        {
+            // a bullet stops at its first asteroid, an asteroid takes
+            // bullets until it breaks; order keeps ties deterministic
+            std::sort(bullet_hits.begin(), bullet_hits.end(), [](bullet_hit const& a, bullet_hit const& b)
+            {
+                return a.t < b.t || (a.t == b.t && a.order < b.order);
+            });
+            for (bullet_hit const& h : bullet_hits)
+            {
+                if (spent(*h.state) || h.target->health == 0)
+                    continue;
+
+                spend(r, h.bullet, *h.state);
+                --h.target->health;
+            }
+        }
+
+        asteroid* killer = nullptr;
+        if (!dead)
+        {
+            asteroid_grid.clear();
+            r.each<position, asteroid>([&](sg::ecs::entity, position const& pos, asteroid& e)
+            {
+                if (e.health != 0)
+                    asteroid_grid.insert(pos.x, pos.y, &e);
+            });
+            asteroid_grid.build();
+            killer = ship_hit(asteroid_grid);
+        }
+        if (killer)
+        {
+            killer->health = 0;
+            // under stress the ship only breaks what it hits
+            if (config.stress_asteroids == 0)
+            {
+                dead = true;
+                explode(ship, ship_velocity, 3);
+            }
+            else
+                killer = nullptr;
+        }
+
+        r.each<position, velocity, asteroid>([&](sg::ecs::entity id, position const& pos, velocity const& v, asteroid& e)
+        {
+            // the one that hit the ship breaks up in the next step
+            if (e.health == 0 && &e != killer)
+            {
+                // fragments become visible at commit(), pos stays valid
+                r.destroy(id);
+                destroy_asteroid(pos, e.size);
+                explode(pos, v, e.size);
+            }
+        });
+    }
+
+    // A tick of the game: everything in it depends on the snapshot of the
+    // previous tick, the inputs and frame_time only, so that late_input()
+    // can run it again.
+    void update(uint32_t frame_time)
+    {
+        model_time += frame_time;
+        if (config.stress_asteroids != 0)
+            autopilot();
+        shoot();
+
+        if (!dead)
+        {
+            switch (ship_rot)
+            {
+            case ship_rotation::left:
+                ship_yaw -= frame_time * 0.005;
+                break;
+            case ship_rotation::right:
+                ship_yaw += frame_time * 0.005;
+                break;
+            default:
+                break;
+            }
+    
+            if (engine_enabled)
+            {
+                ship_velocity.x += frame_time * 0.00007 * 180 * unit * cos(ship_yaw);
+                ship_velocity.y += frame_time * 0.00007 * 180 * unit * sin(ship_yaw);
+            }
+    
+            ship.x = trim_01(ship.x + ship_velocity.x * frame_time * 0.0001);
+            ship.y = trim_01(ship.y + ship_velocity.y * frame_time * 0.0001);
+    
+        }
+
+        // bullets and asteroids move in substeps, the ship once a frame
+        step_time = static_cast<double>(frame_time) / config.substeps;
+        for (uint32_t i = 0; i != config.substeps; ++i)
+        {
+            systems.run(world, ctx().jobs());
+            world.commit();
+        }
+
+        if (config.stress_asteroids != 0)
+        {
+            for (size_t n = world.count<asteroid>(); n < config.stress_asteroids; ++n)
+                gen_asteroid();
+            world.commit();
+        }
+        else if (world.count<asteroid>() == 0)
+        {
+            for (size_t i = 0; i != wave_size(); ++i)
+                gen_asteroid();
+            world.commit();
+        }
+
+        ++tick;
+        if (config.history != 0)
+        {
+            frame_times[tick % frame_times.size()] = frame_time;
+            snapshots.save(tick);
+        }
+    }
+
+    virtual void draw(draw_params const& p)
+    {
+        std::chrono::steady_clock::time_point draw_start = std::chrono::steady_clock::now();
+        update(p.frame_time);
+        if (config.history != 0)
+        {
+            // inputs before the oldest tick cannot be replayed
+            size_t old = 0;
+            while (old != inputs.size() && inputs[old].tick < snapshots.oldest())
+                ++old;
+            inputs.erase(inputs.begin(), inputs.begin() + old);
+        }
+
+        if (engine_enabled && !dead)
+        {
+            // from the back of the hull, against the direction of flight
+            point c(cos(ship_yaw), sin(ship_yaw));
+            sg::particles::burst b;
+            b.x = trim_01(ship.x + ship_p2.x * unit * c.x);
+            b.y = trim_01(ship.y + ship_p2.x * unit * c.y);
+            b.vx = ship_velocity.x * 0.1;
+            b.vy = ship_velocity.y * 0.1;
+            b.angle = ship_yaw + 3.141592;
+            b.spread = 0.35;
+            b.speed_min = 0.1 * unit;
+            b.speed_max = 0.25 * unit;
+            b.life_min = 0.2;
+            b.life_max = 0.5;
+            exhaust.emit(b, p.frame_time / 2 + 1);
+        }
+        explosions.update(p.frame_time * 0.001);
+        exhaust.update(p.frame_time * 0.001);
+
+        asteroid_count = world.count<asteroid>();
+        bullet_count = world.count<bullet>();
+        particle_count = explosions.size() + exhaust.size();
+        particles_dropped = explosions.dropped() + exhaust.dropped();
+        std::chrono::steady_clock::time_point update_end = std::chrono::steady_clock::now();
+
+        // what the view may see, positions after the last commit
+        sprites.clear();
+        world.each<position, asteroid>([&](sg::ecs::entity, position const& pos, asteroid const& e)
+        {
+            sprites.insert(pos.x, pos.y, e.size);
+        });
+        world.each<position, bullet>([&](sg::ecs::entity, position const& pos, bullet const&)
+        {
+            sprites.insert(pos.x, pos.y, bullet_sprite);
+        });
+        sprites.build();
+
+        view.viewport(ctx().width(), ctx().height());
+        view.view(unit, unit);
+        if (config.world_screens > 1.)
+            view.look_at(ship.x, ship.y);
+
+        cairo_t* cr = cairo_create(p.surface);
+
+        cairo_set_source_rgb(cr, 0., 0., 0.);
+        cairo_paint(cr);
+        view.apply(cr);
+        cairo_set_line_width(cr, line_width * unit);
+
+        // the edges of the field
+        view.each_copy(0., view.y(), line_width * unit, [&](double dx, double)
+        {
+            cairo_move_to(cr, dx, -view.view_height() / 2);
+            cairo_line_to(cr, dx, view.view_height() / 2);
+        });
+        view.each_copy(view.x(), 0., line_width * unit, [&](double, double dy)
+        {
+            cairo_move_to(cr, -view.view_width() / 2, dy);
+            cairo_line_to(cr, view.view_width() / 2, dy);
+        });
+        cairo_set_source_rgb(cr, 1., 1., 1.);
+        cairo_stroke(cr);
+
+        explosions.render(cr, view, 0.004 * unit, 1., 0.6, 0.2);
+        exhaust.render(cr, view, 0.003 * unit, 1., 0.45, 0.2);
+
+        if (!dead)
+        {
+            view.each_copy(ship.x, ship.y, ship_radius * unit, [&](double dx, double dy)
+            {
+                // the hull in screens
+                cairo_save(cr);
+                cairo_translate(cr, dx, dy);
+                cairo_scale(cr, unit, unit);
+                cairo_rotate(cr, ship_yaw);
+                cairo_set_line_width(cr, line_width);
+        
+                if (engine_enabled)
+                {
+                    cairo_move_to(cr, -0.1/3.5, -0.06/3.5);
+                    cairo_line_to(cr, -0.1/3.5, 0.06/3.5);
+                    cairo_line_to(cr, -0.2/3.5, 0.05/3.5);
+                    cairo_line_to(cr, -0.1/3.5, 0.);
+                    cairo_line_to(cr, -0.2/3.5, -0.05/3.5);
+                    cairo_close_path(cr);
+                    cairo_set_source_rgb(cr, 200./255., 50./255., 40./255.);
+                    cairo_fill(cr);
+                }
+
+                cairo_move_to(cr, ship_p1.x, ship_p1.y);
+                cairo_line_to(cr, ship_p2.x, ship_p2.y);
+                cairo_line_to(cr, ship_p3.x, ship_p3.y);
+                cairo_close_path(cr);
+                cairo_set_source_rgb(cr, 50./255., 130./255., 40./255.);
+                cairo_fill_preserve(cr);
+                cairo_set_source_rgb(cr, 1., 1., 1.);
+                cairo_stroke(cr);
+                cairo_restore(cr);
+            });
+        }
+
+        // only the sprites around the view get this far; one pass draws
+        // the asteroids and keeps the bullets for above them, in memory
+        // of the frame
+        std::vector<point, sg::arena_allocator<point>> shots{sg::arena_allocator<point>(*p.arena)};
+        shots.reserve(static_cast<size_t>(bullet_count));
+        double reach = view.radius() + (asteroid_sizes[2] + line_width) * unit;
+        sprites.query(view.x(), view.y(), reach, [&](int sprite, double dx, double dy)
+        {
+            if (sprite == bullet_sprite)
+            {
+                shots.push_back(point(dx, dy));
+                return true;
+            }
+
+            double r = asteroid_sizes[sprite] * unit;
+            view.each_offset(dx, dy, r + line_width * unit, [&](double x, double y)
+            {
+                cairo_arc(cr, x, y, r, 0., 2 * 3.1415);
+                cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+                cairo_fill_preserve(cr);
+                cairo_set_source_rgb(cr, 1., 1., 1.);
+                cairo_stroke(cr);
+            });
+            return true;
+        });
+
+        for (point const& shot : shots)
+        {
+            view.each_offset(shot.x, shot.y, bullet_radius * unit, [&](double x, double y)
+            {
+                cairo_arc(cr, x, y, bullet_radius * unit, 0., 2 * 3.1415);
+                cairo_set_source_rgb(cr, 200./255., 221./255., 40./255.);
+                cairo_fill(cr);
+            });
+        }
+        
+        if (dead)
+        {
+            cairo_select_font_face(cr, "Purisa",
+                  CAIRO_FONT_SLANT_NORMAL,
+                  CAIRO_FONT_WEIGHT_BOLD);
+
+            // in screens, whatever the view
+            cairo_identity_matrix(cr);
+            cairo_scale(cr, ctx().width(), ctx().height());
+            cairo_set_source_rgb(cr, 1., 1., 1.);
+            cairo_set_font_size(cr, 0.1);
+            draw_text(cr, "Died!", 0.5, 0.5);
+            cairo_set_font_size(cr, 0.05);
+            draw_text(cr, "Press ESC to restart", 0.5, 0.56);
+            
+        }
+        cairo_surface_flush(p.surface);
+        cairo_destroy(cr);        
+
+        if (config.log_interval.count() != 0)
+            soak_report(p.frame_time, draw_start, update_end);
+    }
+
+    // Turns one way, then the other, with the engine in bursts, and fires
+    // all the time; driven by model time so that runs repeat.
+    void autopilot()
+    {
+        uint64_t phase = model_time % 3000;
+        ship_rot = phase < 1500 ? ship_rotation::right : ship_rotation::left;
+        engine_enabled = model_time % 2000 < 500;
+        shooting_enabled = true;
+    }
+
+    // resident set size in KB, 0 without /proc
+    static long rss_kb()
+    {
+        std::ifstream statm("/proc/self/statm");
+        long size = 0;
+        long resident = 0;
+        statm >> size >> resident;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    // A line per log_interval of model time, so that a soak run shows a
+    // frame time, entity count or memory trend; times in ms p50/p99 of
+    // the frames since the last line.
+    void soak_report(uint32_t frame_time, std::chrono::steady_clock::time_point draw_start,
+                     std::chrono::steady_clock::time_point update_end)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        frame_ms.add(frame_time);
+        update_ms.add(std::chrono::duration<double, std::milli>(update_end - draw_start).count());
+        draw_ms.add(std::chrono::duration<double, std::milli>(now - draw_start).count());
+        ++log_frames;
+
+        if (model_time < next_log)
+            return;
+        next_log = model_time + config.log_interval.count();
+
+        std::clog << "asteroids: " << model_time / 1000 << " s, " << log_frames << " frames, ms p50/p99: ";
+        sg::print_percentiles(std::clog, "interval", frame_ms);
+        std::clog << ", ";
+        sg::print_percentiles(std::clog, "update", update_ms);
+        std::clog << ", ";
+        sg::print_percentiles(std::clog, "draw", draw_ms);
+        std::clog << "; " << asteroid_count << " asteroids, " << bullet_count << " bullets, rss "
+                  << rss_kb() << " KB" << std::endl;
+
+        log_frames = 0;
+        frame_ms.clear();
+        update_ms.clear();
+        draw_ms.clear();
+    }
+
+    void draw_text(cairo_t* cr, char const* text, double x, double y)
+    {
+        cairo_text_extents_t extents;
+        cairo_text_extents(cr, text, &extents);
+        cairo_move_to(cr, x - extents.width / 2, y - extents.height / 2);
+        cairo_show_text(cr, text);
+    }
+    
+    // The keys that steer the ship; false for the others. The inputs
+    // late_input() replays.
+    bool control(SDL_Keycode key, bool down)
+    {
+        switch (key)
+        {
+        case SDLK_LEFT:
+        case SDLK_a:
+            if (down)
+                ship_rot = ship_rotation::left;
+            else if (ship_rot == ship_rotation::left)
+                ship_rot = ship_rotation::none;
+            return true;
+        case SDLK_RIGHT:
+        case SDLK_d:
+            if (down)
+                ship_rot = ship_rotation::right;
+            else if (ship_rot == ship_rotation::right)
+                ship_rot = ship_rotation::none;
+            return true;
+        case SDLK_UP:
+        case SDLK_w:
+            engine_enabled = down;
+            return true;
+        case SDLK_SPACE:
+        case SDLK_LCTRL:
+        case SDLK_RCTRL:
+            // shoot() fires at the next tick
+            shooting_enabled = down;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // between tick and the next one
+    void log_input(SDL_Keycode key, bool down)
+    {
+        if (config.history != 0)
+            inputs.push_back(input{tick, key, down});
+    }
+
+    void key_down(key_down_params const& p)
+    {
+        if (control(p.key, true))
+        {
+            log_input(p.key, true);
+            return;
+        }
+
+        switch (p.key)
+        {
+        case SDLK_BACKSPACE:
+            rewind(1000);
+            break;
+        case SDLK_ESCAPE:
+            // a new game is a new model
+            if (dead)
+                ctx().restart();
+            break;
+        case SDLK_f:
+            ctx().toggle_fullscreen();
+            break;
+        case SDLK_q:
+            if (dead)
+                ctx().quit();
+            break;
+        default:
+            sg::model::key_down(p);
+            break;
+        }
+    }
+
+    void key_up(key_up_params const& p)
+    {
+        if (control(p.key, false))
+        {
+            log_input(p.key, false);
+            return;
+        }
+
+        sg::model::key_up(p);
+    }
+
+    // Goes back by ms of model time, or as far as the history reaches;
+    // what happened since is gone, the ship can be alive again.
+    void rewind(uint64_t ms)
+    {
+        if (config.history == 0)
+            return;
+
+        uint64_t target = tick;
+        for (uint64_t back = 0; target != snapshots.oldest() && back < ms; --target)
+            back += frame_times[target % frame_times.size()];
+
+        if (!snapshots.restore(target))
+            return;
+        tick = target;
+        while (!inputs.empty() && inputs.back().tick >= tick)
+            inputs.pop_back();
+        explosions.clear();
+        exhaust.clear();
+    }
+
+    // An input that belonged between at and the next tick arrives after
+    // tick has gone on: goes back to at, applies it after the inputs that
+    // came in time, and simulates the ticks since again with their inputs
+    // and frame times. false, and nothing changes, if at is out of the
+    // history.
+    bool late_input(uint64_t at, SDL_Keycode key, bool down)
+    {
+        if (config.history == 0 || at > tick || at < snapshots.oldest())
+            return false;
+
+        uint64_t now = tick;
+        if (!snapshots.restore(at))
+            return false;
+        tick = at;
+
+        size_t i = 0;
+        while (i != inputs.size() && inputs[i].tick <= at)
+            ++i;
+        inputs.insert(inputs.begin() + i, input{at, key, down});
+
+        // the debris of the first pass stays, no second burst
+        resimulating = true;
+        i = 0;
+        while (i != inputs.size() && inputs[i].tick < at)
+            ++i;
+        for (;; update(frame_times[(tick + 1) % frame_times.size()]))
+        {
+            for (; i != inputs.size() && inputs[i].tick == tick; ++i)
+                control(inputs[i].key, inputs[i].down);
+            if (tick == now)
+                break;
+        }
+        resimulating = false;
+        return true;
+    }
+
+    uint64_t ticks() const
+    {
+        return tick;
+    }
+
+    // What a tick leaves for the next one as bytes, to compare runs by:
+    // the rows of the world, the ship and ctx().random(), without the
+    // particles, which are for show. Unlike the snapshot blocks it does
+    // not depend on reserved room or on the handles of the entities.
+    void state(std::vector<unsigned char>& out)
+    {
+        out.clear();
+        world.each<position, velocity, asteroid>([&](sg::ecs::entity, position const& pos, velocity const& v, asteroid const& e)
+        {
+            append_state(out, pos);
+            append_state(out, v);
+            append_state(out, e);
+        });
+        world.each<position, velocity, bullet>([&](sg::ecs::entity, position const& pos, velocity const& v, bullet const& b)
+        {
+            append_state(out, pos);
+            append_state(out, v);
+            append_state(out, b);
+        });
+        append_state(out, ctx().random());
+        append_state(out, dead);
+        append_state(out, ship);
+        append_state(out, ship_velocity);
+        append_state(out, ship_yaw);
+        append_state(out, ship_rot);
+        append_state(out, engine_enabled);
+        append_state(out, shooting_enabled);
+        append_state(out, next_shot);
+        append_state(out, model_time);
+        append_state(out, tick);
+    }
+
+    void gen_asteroid()
+    {
+        position pos;
+        for (size_t i = 0;; ++i)
+        {
+            pos.x = ctx().random().uniform();
+            pos.y = ctx().random().uniform();
+
+            double dx = sg::torus_delta(ship.x, pos.x);
+            double dy = sg::torus_delta(ship.y, pos.y);
+            if (dx * dx + dy * dy > 0.2 * unit * 0.2 * unit || i == 20)
+                break;
+        }
+
+        double norm = 1.22 * unit * (0.4 + 0.6 * ctx().random().uniform());
+        double arg = ctx().random().uniform() * 2 * 3.141592;
+        world.create(pos, velocity(norm * cos(arg), norm * sin(arg)), asteroid{2, 3});
+    }
+    
+    void destroy_asteroid(point pos, int size)
+    {
+        size_t n;
+        double speed;
+        switch (size)
+        {
+        case 0:
+            return;
+        case 1:
+            n = 3;
+            speed = 3.1;
+            break;
+        case 2:
+            n = 2;
+            speed = 2.;
+            break;
+        default:
+            assert(false);
+            return;
+        }
+
+        for (size_t i = 0; i != n; ++i)
+        {
+            double norm = speed * unit * (0.6 + 0.4 * ctx().random().uniform());
+            double arg = ctx().random().uniform() * 2 * 3.141592;
+            world.create(position(pos.x, pos.y),
+                         velocity(norm * cos(arg), norm * sin(arg)),
+                         asteroid{size - 1, size});
+        }
+    }
+
+    // a burst of debris the bigger the asteroid, v in model units
+    void explode(point pos, point v, int size)
+    {
+        static size_t const counts[4] = {40, 90, 160, 240};
+
+        sg::particles::burst b;
+        b.x = pos.x;
+        b.y = pos.y;
+        b.vx = v.x * 0.1;
+        b.vy = v.y * 0.1;
+        b.angle = 0.;
+        b.spread = 3.141592;
+        b.speed_min = 0.02 * unit;
+        b.speed_max = 0.3 * unit;
+        b.life_min = 0.3;
+        b.life_max = 1.;
+        if (!resimulating)
+            explosions.emit(b, counts[size]);
+    }
+
+    // asteroids per wave, three per screen of the field
+    size_t wave_size() const
+    {
+        return std::max<size_t>(3, std::lround(3 * config.world_screens * config.world_screens));
+    }
+
+    // wraps v onto [0, 1), as sg::kernel_set::integrate_wrap does
+    static double trim_01(double v)
+    {
+        double r = v - floor(v);
+        // a tiny negative v rounds up to 1
+        return r < 1. ? r : 0.;
+    }
+
+private:
+    // the value of a bullet in sprites, asteroids have their size
+    static constexpr int bullet_sprite = -1;
+
+    template <typename T>
+    static void append_state(std::vector<unsigned char>& out, T const& value)
+    {
+        unsigned char const* p = reinterpret_cast<unsigned char const*>(&value);
+        out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    // a control() key logged between tick and the next one
+    struct input
+    {
+        uint64_t tick;
+        SDL_Keycode key;
+        bool down;
+    };
+
+    // the bullets in bullet_grid
+    struct bullet_ref
+    {
+        sg::ecs::entity id;
+        point v;
+        bullet* state;
+    };
+
+    // a swept bullet reaching an asteroid at t of the step
+    struct bullet_hit
+    {
+        double t;
+        uint32_t order;
+        sg::ecs::entity bullet;
+        struct bullet* state;
+        asteroid* target;
+    };
+
+    settings config;
+    // a screen in torus units
+    double unit;
+    bool dead;
+    point ship;
+    point ship_velocity;
+    double ship_yaw;
+    ship_rotation ship_rot;
+    bool engine_enabled;
+    bool shooting_enabled;
+    // model time of the next shot while firing
+    uint64_t next_shot;
+    double step_time;
+    sg::ecs::registry world;
+    sg::ecs::schedule systems;
+    // rebuilt by collisions() every frame
+    sg::spatial_grid<bullet_ref> bullet_grid;
+    sg::spatial_grid<asteroid*> asteroid_grid;
+    std::vector<bullet_hit> bullet_hits;
+    // indices of the bullets age_bullets() destroys
+    std::vector<uint32_t> expired;
+    // ship_hit() scratch, asteroids near the ship in ship space
+    std::vector<asteroid*> candidates;
+    std::vector<double> candidate_x;
+    std::vector<double> candidate_y;
+    std::vector<double> candidate_r;
+    std::vector<uint32_t> hits;
+    // rebuilt by draw() every frame, what the view culls with
+    sg::spatial_grid<int> sprites;
+    sg::camera view;
+    // emitted by collisions() and draw(), never concurrently
+    sg::particles explosions;
+    sg::particles exhaust;
+    int64_t& asteroid_count;
+    int64_t& bullet_count;
+    int64_t& particle_count;
+    int64_t& particles_dropped;
+    // ms since the model started, in frame times
+    uint64_t model_time;
+    // update() calls, the snapshots are at ticks
+    uint64_t tick;
+    sg::snapshot snapshots;
+    // frame time of every tick in the history, at tick % size()
+    std::vector<uint32_t> frame_times;
+    // inputs since the oldest snapshot, in order
+    std::vector<input> inputs;
+    bool resimulating;
+    // soak_report() state
+    uint64_t next_log;
+    size_t log_frames;
+    sg::sample_series frame_ms;
+    sg::sample_series update_ms;
+    sg::sample_series draw_ms;
+};
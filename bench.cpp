@@ -0,0 +1,1112 @@
+#include "headless.h"
+#include "alloc_audit.h"
+#include "frame_stats.h"
+#include "asteroids_model.h"
+#include "circles_model.h"
+#include "house_model.h"
+#include "kernels.h"
+#include "particles.h"
+#include "random.h"
+#include "snake_model.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    // Input sequence of a model: called before every frame with its index.
+    typedef void (*script_func)(sg::headless&, size_t frame);
+
+    void house_script(sg::headless& h, size_t frame)
+    {
+        if (frame % 400 == 100)
+            h.key_down(SDLK_RIGHT);
+        if (frame % 400 == 300)
+            h.key_up(SDLK_RIGHT);
+    }
+
+    void circles_script(sg::headless&, size_t)
+    {}
+
+    void snake_script(sg::headless& h, size_t frame)
+    {
+        static SDL_Keycode const turns[] = {SDLK_DOWN, SDLK_LEFT, SDLK_UP, SDLK_RIGHT};
+
+        if (frame % 21 == 0)
+        {
+            SDL_Keycode key = turns[frame / 21 % 4];
+            h.key_down(key);
+            h.key_up(key);
+        }
+    }
+
+    void asteroids_script(sg::headless& h, size_t frame)
+    {
+        if (frame == 0)
+            h.key_down(SDLK_SPACE);
+        if (frame % 90 == 0)
+            h.key_down(SDLK_w);
+        if (frame % 90 == 45)
+            h.key_up(SDLK_w);
+        if (frame % 60 == 0)
+            h.key_down(SDLK_LEFT);
+        if (frame % 60 == 20)
+            h.key_up(SDLK_LEFT);
+        if (frame % 120 == 119)
+        {
+            // restarts the game if the ship is dead, ignored otherwise
+            h.key_down(SDLK_ESCAPE);
+            h.key_up(SDLK_ESCAPE);
+        }
+    }
+
+    struct bench_model
+    {
+        char const* name;
+        sg::win_params params;
+        script_func script;
+    };
+
+    std::vector<bench_model> all_models()
+    {
+        constexpr uint32_t snake_cell_size = 42;
+
+        std::vector<bench_model> result;
+        result.push_back({"house",
+                          sg::win_params().width(512).height(512).model<house_model>(),
+                          &house_script});
+        result.push_back({"circles",
+                          sg::win_params().width(512).height(512).model<circles_model>(),
+                          &circles_script});
+        result.push_back({"snake",
+                          sg::win_params()
+                              .width(snake_model::field_size_x * snake_cell_size)
+                              .height(snake_model::field_size_y * snake_cell_size)
+                              .model<snake_model>(),
+                          &snake_script});
+        result.push_back({"asteroids",
+                          sg::win_params().width(720).height(720).model<asteroids_model>(),
+                          &asteroids_script});
+        // what it costs to not miss hits at long frames, run them with a
+        // larger --frame-time
+        asteroids_model::settings swept;
+        swept.test = asteroids_model::bullet_test::swept;
+        result.push_back({"asteroids-swept",
+                          sg::win_params().width(720).height(720).model<asteroids_model>(swept),
+                          &asteroids_script});
+        asteroids_model::settings substeps;
+        substeps.substeps = 4;
+        result.push_back({"asteroids-substeps4",
+                          sg::win_params().width(720).height(720).model<asteroids_model>(substeps),
+                          &asteroids_script});
+        // sixteen times the asteroids of a screen, drawing about as many
+        // as one
+        asteroids_model::settings world;
+        world.world_screens = 4.;
+        result.push_back({"asteroids-world4",
+                          sg::win_params().width(720).height(720).model<asteroids_model>(world),
+                          &asteroids_script});
+        return result;
+    }
+
+    struct options
+    {
+        options()
+            : frames(2000)
+            , frame_time(16)
+            , seed(1)
+            , tolerance(10.)
+            , alloc_audit(false)
+            , alloc_audit_warmup(0)
+            , kernel_entities(0)
+            , particle_count(0)
+            , snapshot_kb(0)
+            , rollback_frames(0)
+        {}
+
+        size_t frames;
+        uint32_t frame_time;
+        unsigned seed;
+        std::vector<std::string> models;
+        std::string output;
+        std::string baseline;
+        std::string replay;
+        double tolerance; // percent
+        bool alloc_audit;
+        size_t alloc_audit_warmup;
+        size_t kernel_entities; // 0: run the models
+        size_t particle_count; // 0: run the models
+        size_t snapshot_kb; // 0: run the models
+        size_t rollback_frames; // 0: run the models
+    };
+
+    struct result
+    {
+        std::string name;
+        size_t frames;
+        double fps;
+        double p50_us;
+        double p90_us;
+        double p99_us;
+        double max_us;
+        long peak_rss_kb;
+        long steady_allocations; // -1 if not audited, or without the hooks in a sanitizer build
+    };
+
+    long peak_rss_kb()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    typedef std::chrono::steady_clock clock;
+
+    double elapsed_us(clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    }
+
+    // Entities as asteroids_model moves them: a column of positions, one of
+    // velocities, and the ttl of the bullets among them.
+    struct kernel_data
+    {
+        kernel_data(size_t n, unsigned seed)
+            : pos(2 * n)
+            , vel(2 * n)
+            , ttl(n)
+            , expired(n)
+            , cx(n)
+            , cy(n)
+            , cr(n)
+        {
+            sg::random rnd(seed);
+            for (size_t i = 0; i != 2 * n; ++i)
+            {
+                pos[i] = rnd.uniform();
+                vel[i] = rnd.uniform(-3.1, 3.1);
+            }
+            for (size_t i = 0; i != n; ++i)
+                ttl[i] = rnd.uniform(0., 0.8);
+
+            // asteroids around the ship, as ship_hit() sees them
+            for (size_t i = 0; i != n; ++i)
+            {
+                cx[i] = rnd.uniform(-0.1, 0.1);
+                cy[i] = rnd.uniform(-0.1, 0.1);
+                cr[i] = asteroid_sizes[rnd.below(3)] - collision_tolerance;
+            }
+
+            // where wrapping rounds: just below 1 and a tiny step below 0
+            for (size_t i = 0; i < 2 * n; i += 61)
+            {
+                pos[i] = std::nextafter(1., 0.);
+                vel[i] = 0.;
+            }
+            for (size_t i = 1; i < 2 * n; i += 67)
+            {
+                pos[i] = 0.;
+                vel[i] = -1e-300;
+            }
+        }
+
+        std::vector<double> pos;
+        std::vector<double> vel;
+        std::vector<double> ttl;
+        std::vector<uint32_t> expired;
+        std::vector<double> cx;
+        std::vector<double> cy;
+        std::vector<double> cr;
+    };
+
+    constexpr double hull_x[3] = {ship_p1.x, ship_p2.x, ship_p3.x};
+    constexpr double hull_y[3] = {ship_p1.y, ship_p2.y, ship_p3.y};
+
+    size_t hull_hits(sg::kernel_set const& k, kernel_data& d)
+    {
+        return k.polygon_hits(hull_x, hull_y, 3, d.cx.data(), d.cy.data(), d.cr.data(),
+                              d.ttl.size(), d.expired.data());
+    }
+
+    struct kernel_result
+    {
+        sg::simd level;
+        bool equal; // to the scalar reference
+        double integrate_ns; // per entity, median
+        double expire_ns;
+        double hull_ns; // per circle
+    };
+
+    constexpr double kernel_k = 16 * 0.0001; // asteroids_model::move at 16 ms
+    constexpr double kernel_dt = 16 * 0.001;
+
+    // Runs frames steps of both kernels, ttl is refilled when it runs out.
+    // Returns false if the expired indices differ from reference's.
+    bool kernel_steps(sg::kernel_set const& k, kernel_data& d, size_t frames,
+                      std::vector<std::vector<uint32_t>> const* reference,
+                      std::vector<std::vector<uint32_t>>* record,
+                      sg::sample_series* integrate_us, sg::sample_series* expire_us)
+    {
+        size_t n = d.ttl.size();
+        for (size_t f = 0; f != frames; ++f)
+        {
+            clock::time_point start = clock::now();
+            k.integrate_wrap(d.pos.data(), d.vel.data(), 2 * n, kernel_k);
+            if (integrate_us)
+                integrate_us->add(elapsed_us(start));
+
+            start = clock::now();
+            size_t count = k.expire(d.ttl.data(), n, kernel_dt, d.expired.data());
+            if (expire_us)
+                expire_us->add(elapsed_us(start));
+
+            if (record)
+                record->emplace_back(d.expired.begin(), d.expired.begin() + count);
+            if (reference
+             && ((*reference)[f].size() != count
+              || !std::equal(d.expired.begin(), d.expired.begin() + count, (*reference)[f].begin())))
+                return false;
+
+            for (size_t i = 0; i != count; ++i)
+                d.ttl[d.expired[i]] += 0.8;
+        }
+        return true;
+    }
+
+    // == takes -0. for 0. and a NaN for different from itself
+    bool same_bits(std::vector<double> const& a, std::vector<double> const& b)
+    {
+        return a.size() == b.size()
+            && std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+    }
+
+    // Every instruction set against the scalar reference: bit equal
+    // results after a few dozen frames and the same ship hull hits, then
+    // the time per entity.
+    std::vector<kernel_result> run_kernels(options const& opts)
+    {
+        constexpr size_t check_frames = 64;
+        size_t n = opts.kernel_entities;
+
+        kernel_data reference(n, opts.seed);
+        std::vector<std::vector<uint32_t>> reference_expired;
+        kernel_steps(*sg::kernels(sg::simd::scalar), reference, check_frames,
+                     nullptr, &reference_expired, nullptr, nullptr);
+        size_t hull_count = hull_hits(*sg::kernels(sg::simd::scalar), reference);
+        std::vector<uint32_t> reference_hull(reference.expired.begin(), reference.expired.begin() + hull_count);
+
+        std::vector<kernel_result> results;
+        for (sg::simd level : {sg::simd::scalar, sg::simd::sse2, sg::simd::avx2})
+        {
+            sg::kernel_set const* k = sg::kernels(level);
+            if (!k)
+                continue;
+
+            kernel_result r;
+            r.level = level;
+
+            kernel_data d(n, opts.seed);
+            r.equal = kernel_steps(*k, d, check_frames, &reference_expired, nullptr, nullptr, nullptr)
+                   && same_bits(d.pos, reference.pos)
+                   && same_bits(d.ttl, reference.ttl);
+            r.equal = r.equal
+                   && hull_hits(*k, d) == hull_count
+                   && std::equal(reference_hull.begin(), reference_hull.end(), d.expired.begin());
+
+            sg::sample_series integrate_us;
+            sg::sample_series expire_us;
+            integrate_us.reserve(opts.frames);
+            expire_us.reserve(opts.frames);
+            kernel_steps(*k, d, opts.frames, nullptr, nullptr, &integrate_us, &expire_us);
+            r.integrate_ns = integrate_us.percentile(0.5) * 1000. / n;
+            r.expire_ns = expire_us.percentile(0.5) * 1000. / n;
+
+            sg::sample_series hull_us;
+            hull_us.reserve(opts.frames);
+            for (size_t f = 0; f != opts.frames; ++f)
+            {
+                clock::time_point start = clock::now();
+                hull_hits(*k, d);
+                hull_us.add(elapsed_us(start));
+            }
+            r.hull_ns = hull_us.percentile(0.5) * 1000. / n;
+            results.push_back(r);
+        }
+        return results;
+    }
+
+    void write_kernels_json(std::ostream& os, options const& opts, std::vector<kernel_result> const& results)
+    {
+        double scalar_ns = results.front().integrate_ns;
+        os << "{\n"
+           << "  \"entities\": " << opts.kernel_entities << ",\n"
+           << "  \"frames\": " << opts.frames << ",\n"
+           << "  \"active\": \"" << sg::simd_name(sg::kernels().level) << "\",\n"
+           << "  \"kernels\": [\n";
+        for (size_t i = 0; i != results.size(); ++i)
+        {
+            kernel_result const& r = results[i];
+            os << "    {\"simd\": \"" << sg::simd_name(r.level) << "\""
+               << ", \"equal\": " << (r.equal ? "true" : "false")
+               << ", \"integrate_ns\": " << r.integrate_ns
+               << ", \"expire_ns\": " << r.expire_ns
+               << ", \"hull_ns\": " << r.hull_ns
+               << ", \"integrate_speedup\": " << (r.integrate_ns > 0 ? scalar_ns / r.integrate_ns : 0.)
+               << "}" << (i + 1 != results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n"
+           << "}\n";
+    }
+
+    struct particle_result
+    {
+        double emit_ns; // per particle, median
+        double update_ns;
+        double render_ns;
+        double mean_size;
+    };
+
+    // A steady state of opts.particle_count particles: each frame ages
+    // them by 16 ms, expires some and emits their replacements, then draws
+    // them into a 720x720 ARGB32 buffer.
+    particle_result run_particles(options const& opts)
+    {
+        constexpr int side = 720;
+        size_t n = opts.particle_count;
+
+        sg::particles p(n, opts.seed);
+        sg::camera view;
+        view.viewport(side, side);
+        std::vector<uint8_t> pixels(side * side * 4);
+        sg::random rnd(opts.seed);
+
+        sg::particles::burst b;
+        b.vx = 0.;
+        b.vy = 0.;
+        b.angle = 0.;
+        b.spread = 3.141592;
+        b.speed_min = 0.02;
+        b.speed_max = 0.3;
+        b.life_min = 0.5;
+        b.life_max = 2.;
+
+        sg::sample_series emit_ns;
+        sg::sample_series update_ns;
+        sg::sample_series render_ns;
+        emit_ns.reserve(opts.frames);
+        update_ns.reserve(opts.frames);
+        render_ns.reserve(opts.frames);
+        double size_sum = 0.;
+        for (size_t f = 0; f != opts.frames; ++f)
+        {
+            clock::time_point start = clock::now();
+            size_t emitted = 0;
+            // bursts of 100 until the losses are made up
+            while (p.size() < n * 3 / 4)
+            {
+                b.x = rnd.uniform();
+                b.y = rnd.uniform();
+                emitted += p.emit(b, 100);
+            }
+            if (emitted != 0)
+                emit_ns.add(elapsed_us(start) * 1000. / emitted);
+
+            start = clock::now();
+            p.update(0.016);
+            update_ns.add(elapsed_us(start) * 1000. / std::max<size_t>(p.size(), 1));
+
+            start = clock::now();
+            p.render(pixels.data(), side, side, side * 4, CAIRO_FORMAT_ARGB32,
+                     view, view.scale_x(), view.scale_y(), side / 2., side / 2., 0.004, 1., 0.6, 0.2);
+            render_ns.add(elapsed_us(start) * 1000. / std::max<size_t>(p.size(), 1));
+            size_sum += p.size();
+        }
+
+        particle_result r;
+        r.emit_ns = emit_ns.percentile(0.5);
+        r.update_ns = update_ns.percentile(0.5);
+        r.render_ns = render_ns.percentile(0.5);
+        r.mean_size = opts.frames != 0 ? size_sum / opts.frames : 0.;
+        return r;
+    }
+
+    void write_particles_json(std::ostream& os, options const& opts, particle_result const& r)
+    {
+        os << "{\n"
+           << "  \"capacity\": " << opts.particle_count << ",\n"
+           << "  \"frames\": " << opts.frames << ",\n"
+           << "  \"simd\": \"" << sg::simd_name(sg::kernels().level) << "\",\n"
+           << "  \"mean_particles\": " << r.mean_size << ",\n"
+           << "  \"emit_ns\": " << r.emit_ns << ",\n"
+           << "  \"update_ns\": " << r.update_ns << ",\n"
+           << "  \"render_ns\": " << r.render_ns << "\n"
+           << "}\n";
+    }
+
+    struct snapshot_result
+    {
+        size_t state_bytes;
+        double save_us; // median
+        double restore_1_us; // one tick back, median
+        double restore_60_us; // sixty ticks back
+        double copy_us; // a memcpy of the state, for scale
+        double delta_bytes; // ring bytes per tick
+    };
+
+    // A state of columns of doubles as asteroids_model has them: half of it
+    // positions that move every tick, half velocities that rarely change.
+    // Every state size from 1 KB, doubling up to opts.snapshot_kb, gets
+    // opts.frames ticks of 600 kept.
+    std::vector<snapshot_result> run_snapshots(options const& opts)
+    {
+        constexpr size_t history = 600;
+
+        std::vector<snapshot_result> results;
+        for (size_t kb = 1; kb <= opts.snapshot_kb; kb *= 2)
+        {
+            size_t n = kb * 1024 / sizeof(double) / 2;
+            std::vector<double> pos(n);
+            std::vector<double> vel(n);
+            sg::random rnd(opts.seed);
+            for (size_t i = 0; i != n; ++i)
+            {
+                pos[i] = rnd.uniform();
+                vel[i] = rnd.uniform(-0.01, 0.01);
+            }
+            uint64_t tick = 0;
+
+            sg::snapshot s(history, std::min<size_t>(history * (kb * 1024 / 2 + 1024), 256 << 20));
+            s.add(pos);
+            s.add(vel);
+            s.add(tick);
+            auto move = [&]
+            {
+                for (size_t i = 0; i != n; ++i)
+                    pos[i] += vel[i];
+                vel[rnd.below(static_cast<uint32_t>(n))] = rnd.uniform(-0.01, 0.01);
+            };
+
+            sg::sample_series save_us;
+            save_us.reserve(opts.frames);
+            for (size_t f = 0; f != opts.frames; ++f)
+            {
+                move();
+                clock::time_point start = clock::now();
+                s.save(++tick);
+                save_us.add(elapsed_us(start));
+            }
+            snapshot_result r;
+            r.state_bytes = s.state_bytes();
+            r.delta_bytes = static_cast<double>(s.delta_bytes()) / std::max<uint64_t>(s.latest() - s.oldest(), 1);
+
+            // restoring forgets the ticks after, which are simulated again
+            sg::sample_series restore_1_us;
+            sg::sample_series restore_60_us;
+            sg::sample_series copy_us;
+            std::vector<double> copy(2 * n);
+            for (size_t sample = 0; sample != 50; ++sample)
+            {
+                for (uint64_t back : {1, 60})
+                {
+                    if (s.latest() - s.oldest() < back)
+                        continue;
+
+                    clock::time_point start = clock::now();
+                    bool ok = s.restore(s.latest() - back);
+                    (back == 1 ? restore_1_us : restore_60_us).add(elapsed_us(start));
+                    assert(ok);
+                    (void)ok;
+                    for (uint64_t i = 0; i != back; ++i)
+                    {
+                        move();
+                        s.save(++tick);
+                    }
+                }
+
+                clock::time_point start = clock::now();
+                std::memcpy(copy.data(), pos.data(), n * sizeof(double));
+                std::memcpy(copy.data() + n, vel.data(), n * sizeof(double));
+                copy_us.add(elapsed_us(start));
+            }
+
+            r.save_us = save_us.percentile(0.5);
+            r.restore_1_us = restore_1_us.size() != 0 ? restore_1_us.percentile(0.5) : 0.;
+            r.restore_60_us = restore_60_us.size() != 0 ? restore_60_us.percentile(0.5) : 0.;
+            r.copy_us = copy_us.percentile(0.5);
+            results.push_back(r);
+        }
+        return results;
+    }
+
+    void write_snapshots_json(std::ostream& os, options const& opts, std::vector<snapshot_result> const& results)
+    {
+        os << "{\n"
+           << "  \"ticks\": " << opts.frames << ",\n"
+           << "  \"history\": 600,\n"
+           << "  \"states\": [\n";
+        for (size_t i = 0; i != results.size(); ++i)
+        {
+            snapshot_result const& r = results[i];
+            os << "    {\"state_bytes\": " << r.state_bytes
+               << ", \"save_us\": " << r.save_us
+               << ", \"restore_1_us\": " << r.restore_1_us
+               << ", \"restore_60_us\": " << r.restore_60_us
+               << ", \"copy_us\": " << r.copy_us
+               << ", \"delta_bytes_per_tick\": " << r.delta_bytes
+               << "}" << (i + 1 != results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n"
+           << "}\n";
+    }
+
+    // asteroids_script without the restarts, a new model has no history
+    void rollback_script(sg::headless& h, size_t frame)
+    {
+        if (frame == 0)
+            h.key_down(SDLK_SPACE);
+        if (frame % 90 == 0)
+            h.key_down(SDLK_w);
+        if (frame % 90 == 45)
+            h.key_up(SDLK_w);
+        if (frame % 60 == 0)
+            h.key_down(SDLK_LEFT);
+        if (frame % 60 == 20)
+            h.key_up(SDLK_LEFT);
+    }
+
+    // the inputs that arrive late in check_rollback, after the script's
+    struct late_key
+    {
+        SDL_Keycode key;
+        bool down;
+    };
+
+    bool late_key_at(size_t frame, late_key& k)
+    {
+        if (frame % 97 == 10)
+            k = {SDLK_RIGHT, true};
+        else if (frame % 97 == 30)
+            k = {SDLK_RIGHT, false};
+        else
+            return false;
+        return true;
+    }
+
+    // Checks asteroids_model's history against straight runs: a late input
+    // applied by simulating again has to leave the bytes of a run that had
+    // it in time, and a rewind the bytes that tick had. Returns the number
+    // of mismatches.
+    size_t check_rollback(options const& opts)
+    {
+        asteroids_model::settings config;
+        config.history = 600;
+        sg::win_params params = sg::win_params().width(720).height(720).model<asteroids_model>(config);
+        params.seed(opts.seed);
+
+        auto model = [](sg::headless& h) -> asteroids_model&
+        {
+            return dynamic_cast<asteroids_model&>(h.get_model());
+        };
+
+        // the straight run, with the late keys in time
+        std::vector<std::vector<unsigned char>> straight(opts.rollback_frames);
+        {
+            sg::headless h(params);
+            for (size_t f = 0; f != opts.rollback_frames; ++f)
+            {
+                rollback_script(h, f);
+                late_key k;
+                if (late_key_at(f, k))
+                    (k.down ? h.key_down(k.key) : h.key_up(k.key));
+                h.frame(opts.frame_time);
+                model(h).state(straight[f]);
+            }
+        }
+
+        size_t mismatches = 0;
+        std::vector<unsigned char> state;
+
+        // the late keys arrive 1 to 7 frames after the tick they belong to
+        {
+            sg::headless h(params);
+            struct pending
+            {
+                size_t due;
+                uint64_t at;
+                late_key k;
+            };
+            std::vector<pending> late;
+            size_t checked = 0;
+            for (size_t f = 0; f != opts.rollback_frames; ++f)
+            {
+                for (size_t i = 0; i != late.size();)
+                {
+                    if (late[i].due != f)
+                    {
+                        ++i;
+                        continue;
+                    }
+                    if (!model(h).late_input(late[i].at, late[i].k.key, late[i].k.down))
+                    {
+                        std::cerr << "rollback: late input of tick " << late[i].at << " refused at frame " << f << std::endl;
+                        ++mismatches;
+                    }
+                    late.erase(late.begin() + i);
+                }
+
+                rollback_script(h, f);
+                late_key k;
+                if (late_key_at(f, k))
+                    late.push_back({f + 1 + f % 7, model(h).ticks(), k});
+                h.frame(opts.frame_time);
+
+                if (!late.empty())
+                    continue;
+                model(h).state(state);
+                ++checked;
+                if (state != straight[f])
+                {
+                    std::cerr << "rollback: late inputs differ from the straight run at frame " << f << std::endl;
+                    ++mismatches;
+                }
+            }
+            if (checked == 0)
+            {
+                std::cerr << "rollback: no frame without a late input pending" << std::endl;
+                ++mismatches;
+            }
+        }
+
+        // rewinds every 150 frames, compared with what the ticks had
+        {
+            sg::headless h(params);
+            std::vector<std::vector<unsigned char>> by_tick;
+            size_t rewinds = 0;
+            for (size_t f = 0; f != opts.rollback_frames; ++f)
+            {
+                rollback_script(h, f);
+                h.frame(opts.frame_time);
+
+                uint64_t tick = model(h).ticks();
+                by_tick.resize(tick + 1);
+                model(h).state(by_tick[tick]);
+
+                if (f % 150 != 149)
+                    continue;
+                h.key_down(SDLK_BACKSPACE);
+                h.key_up(SDLK_BACKSPACE);
+                tick = model(h).ticks();
+                if (tick + 1 >= by_tick.size())
+                    continue;
+                ++rewinds;
+                model(h).state(state);
+                if (state != by_tick[tick])
+                {
+                    std::cerr << "rollback: rewind to tick " << tick << " differs from it at frame " << f << std::endl;
+                    ++mismatches;
+                }
+                by_tick.resize(tick + 1);
+            }
+            if (opts.rollback_frames >= 150 && rewinds == 0)
+            {
+                std::cerr << "rollback: no rewind went back" << std::endl;
+                ++mismatches;
+            }
+        }
+        return mismatches;
+    }
+
+    result run_model(bench_model const& m, options const& opts)
+    {
+        sg::win_params params = m.params;
+        params.seed(opts.seed);
+
+        std::unique_ptr<sg::input_replayer> replayer;
+        if (!opts.replay.empty())
+        {
+            replayer = std::make_unique<sg::input_replayer>(opts.replay);
+            params.seed(replayer->seed());
+        }
+
+        sg::headless h(params);
+        sg::sample_series frame_us;
+        frame_us.reserve(opts.frames);
+
+        size_t frame = 0;
+        clock::time_point start = clock::now();
+        if (replayer)
+        {
+            sg::input_event e;
+            while (replayer->read(e) && !h.quit_requested())
+            {
+                if (e.type != sg::input_event::type_t::frame)
+                {
+                    h.apply(e);
+                    continue;
+                }
+
+                if (opts.alloc_audit && frame == opts.alloc_audit_warmup)
+                    sg::start_alloc_audit();
+
+                clock::time_point frame_start = clock::now();
+                h.apply(e);
+                frame_us.add(elapsed_us(frame_start));
+                ++frame;
+            }
+        }
+        else
+        {
+            for (; frame != opts.frames && !h.quit_requested(); ++frame)
+            {
+                if (opts.alloc_audit && frame == opts.alloc_audit_warmup)
+                    sg::start_alloc_audit();
+
+                m.script(h, frame);
+
+                clock::time_point frame_start = clock::now();
+                h.frame(opts.frame_time);
+                frame_us.add(elapsed_us(frame_start));
+            }
+        }
+        double total = std::chrono::duration<double>(clock::now() - start).count();
+        sg::stop_alloc_audit();
+
+        result r;
+        r.name = m.name;
+        r.frames = frame;
+        r.fps = total > 0 ? frame / total : 0.;
+        r.p50_us = frame_us.percentile(0.5);
+        r.p90_us = frame_us.percentile(0.9);
+        r.p99_us = frame_us.percentile(0.99);
+        r.max_us = frame_us.max();
+        r.peak_rss_kb = peak_rss_kb();
+        r.steady_allocations = opts.alloc_audit && sg::alloc_audit_linked() && frame > opts.alloc_audit_warmup
+            ? static_cast<long>(sg::audited_allocations())
+            : -1;
+        return r;
+    }
+
+    // The peak RSS of a process never goes down: run_model() runs in a
+    // child of its own, so that a model's peak is not the largest one of
+    // the models before it. The measures come back through a pipe.
+    result run_model_isolated(bench_model const& m, options const& opts)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            std::perror("sg_bench: pipe");
+            std::exit(1);
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::perror("sg_bench: fork");
+            std::exit(1);
+        }
+
+        if (pid == 0)
+        {
+            close(fds[0]);
+            result r = run_model(m, opts);
+            bool ok = true;
+            auto put = [&](auto const& value)
+            {
+                ok = ok && write(fds[1], &value, sizeof value) == static_cast<ssize_t>(sizeof value);
+            };
+            put(r.frames);
+            put(r.fps);
+            put(r.p50_us);
+            put(r.p90_us);
+            put(r.p99_us);
+            put(r.max_us);
+            put(r.peak_rss_kb);
+            put(r.steady_allocations);
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        result r;
+        r.name = m.name;
+        bool ok = true;
+        auto get = [&](auto& value)
+        {
+            ok = ok && read(fds[0], &value, sizeof value) == static_cast<ssize_t>(sizeof value);
+        };
+        get(r.frames);
+        get(r.fps);
+        get(r.p50_us);
+        get(r.p90_us);
+        get(r.p99_us);
+        get(r.max_us);
+        get(r.peak_rss_kb);
+        get(r.steady_allocations);
+        close(fds[0]);
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "sg_bench: " << m.name << " failed" << std::endl;
+            std::exit(1);
+        }
+        return r;
+    }
+
+    void write_json(std::ostream& os, options const& opts, std::vector<result> const& results)
+    {
+        os << "{\n"
+           << "  \"frames\": " << opts.frames << ",\n"
+           << "  \"frame_time_ms\": " << opts.frame_time << ",\n"
+           << "  \"seed\": " << opts.seed << ",\n"
+           << "  \"models\": [\n";
+        for (size_t i = 0; i != results.size(); ++i)
+        {
+            result const& r = results[i];
+            os << "    {\"name\": \"" << r.name << "\""
+               << ", \"frames\": " << r.frames
+               << ", \"fps\": " << r.fps
+               << ", \"p50_us\": " << r.p50_us
+               << ", \"p90_us\": " << r.p90_us
+               << ", \"p99_us\": " << r.p99_us
+               << ", \"max_us\": " << r.max_us
+               << ", \"peak_rss_kb\": " << r.peak_rss_kb;
+            if (r.steady_allocations >= 0)
+                os << ", \"steady_allocations\": " << r.steady_allocations;
+            os << "}" << (i + 1 != results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n"
+           << "}\n";
+    }
+
+    // Finds the model object named name in a report written by write_json
+    // and returns the value of key in it, or a negative value if absent.
+    double baseline_value(std::string const& json, std::string const& name, char const* key)
+    {
+        size_t obj = json.find("\"name\": \"" + name + "\"");
+        if (obj == std::string::npos)
+            return -1.;
+
+        size_t obj_end = json.find('}', obj);
+        size_t pos = json.find(std::string("\"") + key + "\": ", obj);
+        if (pos == std::string::npos || pos > obj_end)
+            return -1.;
+
+        return std::strtod(json.c_str() + pos + std::strlen(key) + 4, nullptr);
+    }
+
+    bool compare(std::string const& baseline_file, double tolerance, std::vector<result> const& results)
+    {
+        std::ifstream f(baseline_file);
+        if (!f)
+        {
+            std::cerr << "failed to open baseline " << baseline_file << std::endl;
+            return false;
+        }
+
+        std::stringstream ss;
+        ss << f.rdbuf();
+        std::string json = ss.str();
+
+        bool ok = true;
+        double k = tolerance / 100.;
+        for (result const& r : results)
+        {
+            double base_fps = baseline_value(json, r.name, "fps");
+            double base_p99 = baseline_value(json, r.name, "p99_us");
+            if (base_fps < 0 || base_p99 < 0)
+            {
+                std::cerr << r.name << ": not in baseline, skipped" << std::endl;
+                continue;
+            }
+
+            bool fps_regressed = r.fps < base_fps * (1. - k);
+            bool p99_regressed = r.p99_us > base_p99 * (1. + k);
+            std::cerr << r.name
+                      << ": fps " << base_fps << " -> " << r.fps
+                      << ", p99 " << base_p99 << " -> " << r.p99_us << " us"
+                      << (fps_regressed || p99_regressed ? "  REGRESSION" : "")
+                      << std::endl;
+            ok = ok && !fps_regressed && !p99_regressed;
+        }
+        return ok;
+    }
+
+    void usage(char const* argv0)
+    {
+        std::cerr << "usage: " << argv0 << " [options]\n"
+                  << "  --frames N        frames per model (default 2000)\n"
+                  << "  --frame-time MS   simulated frame time (default 16)\n"
+                  << "  --seed S          seed of context::random() (default 1)\n"
+                  << "  --model NAME      run only this model, may be repeated\n"
+                  << "  --out FILE        write the JSON report to FILE instead of stdout\n"
+                  << "  --compare FILE    fail if fps or p99 regressed against FILE\n"
+                  << "  --tolerance PCT   allowed regression in percent (default 10)\n"
+                  << "  --alloc-audit N   count and report heap allocations after N frames\n"
+                  << "  --replay FILE     feed a recorded session instead of the script,\n"
+                  << "                    requires a single --model\n"
+                  << "  --kernels N       check the SIMD kernels against the scalar ones on\n"
+                  << "                    N entities and time them for --frames steps\n"
+                  << "                    instead of running the models\n"
+                  << "  --particles N     time sg::particles with a capacity of N for\n"
+                  << "                    --frames frames instead of running the models\n"
+                  << "  --snapshot KB     time sg::snapshot saves over --frames ticks and\n"
+                  << "                    restores on states of 1 KB to KB KB instead\n"
+                  << "                    of running the models\n"
+                  << "  --rollback N      check the asteroids history over N frames: late\n"
+                  << "                    inputs and rewinds against straight runs,\n"
+                  << "                    instead of running the models\n";
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 == argc)
+                return false;
+
+            char const* value = argv[++i];
+            if (arg == "--frames")
+                opts.frames = std::strtoul(value, nullptr, 10);
+            else if (arg == "--frame-time")
+                opts.frame_time = std::strtoul(value, nullptr, 10);
+            else if (arg == "--seed")
+                opts.seed = std::strtoul(value, nullptr, 10);
+            else if (arg == "--model")
+                opts.models.push_back(value);
+            else if (arg == "--out")
+                opts.output = value;
+            else if (arg == "--compare")
+                opts.baseline = value;
+            else if (arg == "--tolerance")
+                opts.tolerance = std::strtod(value, nullptr);
+            else if (arg == "--replay")
+                opts.replay = value;
+            else if (arg == "--particles")
+                opts.particle_count = std::strtoul(value, nullptr, 10);
+            else if (arg == "--snapshot")
+                opts.snapshot_kb = std::strtoul(value, nullptr, 10);
+            else if (arg == "--rollback")
+                opts.rollback_frames = std::strtoul(value, nullptr, 10);
+            else if (arg == "--kernels")
+                opts.kernel_entities = std::strtoul(value, nullptr, 10);
+            else if (arg == "--alloc-audit")
+            {
+                opts.alloc_audit = true;
+                opts.alloc_audit_warmup = std::strtoul(value, nullptr, 10);
+            }
+            else
+                return false;
+        }
+        return (opts.replay.empty() || opts.models.size() == 1)
+            && (opts.kernel_entities == 0 || opts.frames != 0)
+            && (opts.particle_count == 0 || opts.frames != 0)
+            && (opts.snapshot_kb == 0 || opts.frames != 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (opts.particle_count != 0)
+    {
+        particle_result r = run_particles(opts);
+        if (opts.output.empty())
+            write_particles_json(std::cout, opts, r);
+        else
+        {
+            std::ofstream f(opts.output);
+            write_particles_json(f, opts, r);
+        }
+        return 0;
+    }
+
+    if (opts.snapshot_kb != 0)
+    {
+        std::vector<snapshot_result> results = run_snapshots(opts);
+        if (opts.output.empty())
+            write_snapshots_json(std::cout, opts, results);
+        else
+        {
+            std::ofstream f(opts.output);
+            write_snapshots_json(f, opts, results);
+        }
+        return 0;
+    }
+
+    if (opts.rollback_frames != 0)
+    {
+        size_t mismatches = check_rollback(opts);
+        std::cout << "{\n"
+                  << "  \"frames\": " << opts.rollback_frames << ",\n"
+                  << "  \"mismatches\": " << mismatches << "\n"
+                  << "}\n";
+        return mismatches != 0 ? 1 : 0;
+    }
+
+    if (opts.kernel_entities != 0)
+    {
+        std::vector<kernel_result> results = run_kernels(opts);
+        if (opts.output.empty())
+            write_kernels_json(std::cout, opts, results);
+        else
+        {
+            std::ofstream f(opts.output);
+            write_kernels_json(f, opts, results);
+        }
+
+        for (kernel_result const& r : results)
+            if (!r.equal)
+            {
+                std::cerr << sg::simd_name(r.level) << ": differs from the scalar kernels" << std::endl;
+                return 1;
+            }
+        return 0;
+    }
+
+    std::vector<result> results;
+    for (bench_model const& m : all_models())
+    {
+        if (!opts.models.empty()
+         && std::find(opts.models.begin(), opts.models.end(), m.name) == opts.models.end())
+            continue;
+
+        results.push_back(run_model_isolated(m, opts));
+    }
+
+    if (opts.output.empty())
+        write_json(std::cout, opts, results);
+    else
+    {
+        std::ofstream f(opts.output);
+        write_json(f, opts, results);
+    }
+
+    if (!opts.baseline.empty() && !compare(opts.baseline, opts.tolerance, results))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+#include "simple_game_window.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <GL/gl.h>
+
+namespace
+{
+    struct resolution
+    {
+        char const* name;
+        int width;
+        int height;
+    };
+
+    constexpr resolution resolutions[] = {
+        {"512x512", 512, 512},
+        {"720x720", 720, 720},
+        {"1080p", 1920, 1080},
+        {"4k", 3840, 2160},
+    };
+
+    // One drawing operation as the demos issue it. Sizes are relative to the
+    // surface height, the way the demos scale their scenes.
+    struct primitive
+    {
+        char const* name;
+        void (*op)(cairo_t* cr, int w, int h, size_t i);
+        // pixels touched by one call, 0 if not meaningful
+        double (*area)(cairo_t* cr, int w, int h);
+    };
+
+    double scatter(size_t i, int extent, double margin)
+    {
+        // deterministic positions spread over the surface
+        double t = std::fmod(i * 0.618033988749895, 1.);
+        return margin + t * (extent - 2 * margin);
+    }
+
+    void arc_path(cairo_t* cr, int w, int h, size_t i)
+    {
+        double r = 0.04 * h;
+        cairo_arc(cr, scatter(i, w, r), scatter(i * 7 + 3, h, r), r, 0., 2 * M_PI);
+    }
+
+    double arc_area(cairo_t*, int, int h)
+    {
+        double r = 0.04 * h;
+        return M_PI * r * r;
+    }
+
+    double arc_stroke_area(cairo_t*, int, int h)
+    {
+        return 2 * M_PI * 0.04 * h * 0.006 * h;
+    }
+
+    void arc_fill(cairo_t* cr, int w, int h, size_t i)
+    {
+        arc_path(cr, w, h, i);
+        cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+        cairo_fill(cr);
+    }
+
+    void arc_stroke(cairo_t* cr, int w, int h, size_t i)
+    {
+        arc_path(cr, w, h, i);
+        cairo_set_line_width(cr, 0.006 * h);
+        cairo_set_source_rgb(cr, 0., 0., 0.);
+        cairo_stroke(cr);
+    }
+
+    void arc_fill_stroke(cairo_t* cr, int w, int h, size_t i)
+    {
+        arc_path(cr, w, h, i);
+        cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+        cairo_fill_preserve(cr);
+        cairo_set_line_width(cr, 0.006 * h);
+        cairo_set_source_rgb(cr, 0., 0., 0.);
+        cairo_stroke(cr);
+    }
+
+    void rect_fill(cairo_t* cr, int w, int h, size_t i)
+    {
+        double size = h / 15.;
+        double x = scatter(i, w, size);
+        double y = scatter(i * 7 + 3, h, size);
+        cairo_move_to(cr, x, y);
+        cairo_line_to(cr, x + size, y);
+        cairo_line_to(cr, x + size, y + size);
+        cairo_line_to(cr, x, y + size);
+        cairo_close_path(cr);
+        cairo_set_source_rgb(cr, 21./255., 102./255., 25./255.);
+        cairo_fill(cr);
+    }
+
+    double rect_area(cairo_t*, int, int h)
+    {
+        return (h / 15.) * (h / 15.);
+    }
+
+    void paint(cairo_t* cr, int, int, size_t i)
+    {
+        cairo_set_source_rgb(cr, i % 2, 1., 1.);
+        cairo_paint(cr);
+    }
+
+    double paint_area(cairo_t*, int w, int h)
+    {
+        return static_cast<double>(w) * h;
+    }
+
+    char const bench_text[] = "Press ESC to restart";
+
+    void set_font(cairo_t* cr, int h)
+    {
+        cairo_select_font_face(cr, "Purisa", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, 0.05 * h);
+    }
+
+    void show_text(cairo_t* cr, int w, int h, size_t i)
+    {
+        set_font(cr, h);
+        cairo_move_to(cr, scatter(i, w / 2, 0.), scatter(i * 7 + 3, h, 0.05 * h));
+        cairo_set_source_rgb(cr, 0., 0., 0.);
+        cairo_show_text(cr, bench_text);
+    }
+
+    double text_area(cairo_t* cr, int, int h)
+    {
+        set_font(cr, h);
+        cairo_text_extents_t extents;
+        cairo_text_extents(cr, bench_text, &extents);
+        return extents.width * extents.height;
+    }
+
+    void small_rect_then_flush(cairo_t* cr, int w, int h, size_t i)
+    {
+        rect_fill(cr, w, h, i);
+        cairo_surface_flush(cairo_get_target(cr));
+    }
+
+    double no_area(cairo_t*, int, int)
+    {
+        return 0.;
+    }
+
+    constexpr primitive primitives[] = {
+        {"arc_fill", &arc_fill, &arc_area},
+        {"arc_stroke", &arc_stroke, &arc_stroke_area},
+        {"arc_fill_stroke", &arc_fill_stroke, &arc_area},
+        {"rect_fill", &rect_fill, &rect_area},
+        {"paint", &paint, &paint_area},
+        {"show_text", &show_text, &text_area},
+        {"rect_fill+flush", &small_rect_then_flush, &no_area},
+    };
+
+    struct options
+    {
+        options()
+            : min_time_ms(200)
+            , image_only(false)
+        {}
+
+        uint32_t min_time_ms;
+        bool image_only;
+        std::string only;
+    };
+
+    // Runs op in batches until min_time_ms passed; a batch ends with a flush
+    // and, for GL surfaces, glFinish() so that GPU work is included.
+    double measure_ns(cairo_surface_t* surface, bool gl, primitive const& prim,
+                      int w, int h, uint32_t min_time_ms)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        cairo_t* cr = cairo_create(surface);
+
+        auto batch = [&](size_t first, size_t n)
+        {
+            for (size_t i = first; i != first + n; ++i)
+                prim.op(cr, w, h, i);
+            cairo_surface_flush(surface);
+            if (gl)
+                glFinish();
+        };
+
+        batch(0, 16);
+
+        size_t n = 16;
+        size_t total = 0;
+        double elapsed_ns = 0;
+        while (elapsed_ns < min_time_ms * 1e6)
+        {
+            clock::time_point start = clock::now();
+            batch(total, n);
+            elapsed_ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            total += n;
+            if (n < 4096)
+                n *= 2;
+        }
+
+        cairo_destroy(cr);
+        return elapsed_ns / total;
+    }
+
+    void print_header()
+    {
+        std::cout << std::left
+                  << std::setw(8) << "backend"
+                  << std::setw(10) << "size"
+                  << std::setw(18) << "primitive"
+                  << std::right
+                  << std::setw(14) << "ns/op"
+                  << std::setw(14) << "Mpx/s"
+                  << std::endl;
+    }
+
+    void run_backend(char const* backend, bool gl, options const& opts,
+                     cairo_surface_t* (*create)(void* arg, int w, int h), void* arg)
+    {
+        for (resolution const& res : resolutions)
+        {
+            cairo_surface_t* surface = create(arg, res.width, res.height);
+            if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+            {
+                std::cout << std::left
+                          << std::setw(8) << backend
+                          << std::setw(10) << res.name
+                          << "skipped: " << cairo_status_to_string(cairo_surface_status(surface))
+                          << std::endl;
+                cairo_surface_destroy(surface);
+                continue;
+            }
+
+            for (primitive const& prim : primitives)
+            {
+                if (!opts.only.empty() && opts.only != prim.name)
+                    continue;
+
+                double ns = measure_ns(surface, gl, prim, res.width, res.height, opts.min_time_ms);
+
+                cairo_t* cr = cairo_create(surface);
+                double area = prim.area(cr, res.width, res.height);
+                cairo_destroy(cr);
+
+                std::cout << std::left
+                          << std::setw(8) << backend
+                          << std::setw(10) << res.name
+                          << std::setw(18) << prim.name
+                          << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(14) << ns;
+                if (area > 0)
+                    std::cout << std::setw(14) << area / ns * 1e3;
+                else
+                    std::cout << std::setw(14) << "-";
+                std::cout << std::endl;
+            }
+
+            cairo_surface_destroy(surface);
+        }
+    }
+
+    cairo_surface_t* create_image(void*, int w, int h)
+    {
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    }
+
+    cairo_surface_t* create_gl(void* arg, int w, int h)
+    {
+        return cairo_surface_create_similar(static_cast<cairo_surface_t*>(arg),
+                                            CAIRO_CONTENT_COLOR_ALPHA, w, h);
+    }
+
+    // Runs the suite on its first frame, on the cairo-gl device of sg::run,
+    // then quits.
+    struct cairo_bench_model : sg::model
+    {
+        cairo_bench_model(sg::context& ctx, options opts)
+            : sg::model(ctx)
+            , opts(opts)
+        {}
+
+        void draw(draw_params const& p)
+        {
+            run_backend("gl", true, opts, &create_gl, p.surface);
+            run_backend("image", false, opts, &create_image, nullptr);
+            ctx().quit();
+        }
+
+    private:
+        options opts;
+    };
+
+    void usage(char const* argv0)
+    {
+        std::cerr << "usage: " << argv0 << " [options]\n"
+                  << "  --min-time MS     measuring time per primitive and size (default 200)\n"
+                  << "  --primitive NAME  run only this primitive\n"
+                  << "  --image-only      skip the cairo-gl backend, does not open a window\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--image-only") == 0)
+            opts.image_only = true;
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            opts.min_time_ms = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--primitive") == 0 && i + 1 < argc)
+            opts.only = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    print_header();
+
+    if (opts.image_only)
+        run_backend("image", false, opts, &create_image, nullptr);
+    else
+        run(sg::win_params()
+            .width(256)
+            .height(256)
+            .resizing_policy(sg::win_params::resizing_policy_t::no_resize)
+            .title("cairo primitive benchmark")
+            .model<cairo_bench_model>(opts));
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "camera.h"
+
+#include <cassert>
+#include <cmath>
+
+using namespace sg;
+
+camera::camera()
+    : centre_x(0.5)
+    , centre_y(0.5)
+    , half_width(0.5)
+    , half_height(0.5)
+    , pixels_x(1)
+    , pixels_y(1)
+{}
+
+void camera::view(double width, double height)
+{
+    assert(width > 0 && width <= 1 && height > 0 && height <= 1);
+    half_width = width / 2;
+    half_height = height / 2;
+}
+
+void camera::viewport(int width, int height)
+{
+    assert(width > 0 && height > 0);
+    pixels_x = width;
+    pixels_y = height;
+}
+
+void camera::look_at(double x, double y)
+{
+    // 1.0 folds back onto the torus
+    centre_x = x - std::floor(x);
+    centre_y = y - std::floor(y);
+}
+
+double camera::x() const
+{
+    return centre_x;
+}
+
+double camera::y() const
+{
+    return centre_y;
+}
+
+double camera::view_width() const
+{
+    return 2 * half_width;
+}
+
+double camera::view_height() const
+{
+    return 2 * half_height;
+}
+
+double camera::scale_x() const
+{
+    return pixels_x / (2 * half_width);
+}
+
+double camera::scale_y() const
+{
+    return pixels_y / (2 * half_height);
+}
+
+double camera::radius() const
+{
+    return std::hypot(half_width, half_height);
+}
+
+void camera::apply(cairo_t* cr) const
+{
+    cairo_identity_matrix(cr);
+    cairo_translate(cr, pixels_x / 2., pixels_y / 2.);
+    cairo_scale(cr, scale_x(), scale_y());
+}
+
+void camera::to_screen(double x, double y, double& px, double& py) const
+{
+    px = offset(centre_x, x - std::floor(x)) * scale_x() + pixels_x / 2.;
+    py = offset(centre_y, y - std::floor(y)) * scale_y() + pixels_y / 2.;
+}
+
+void camera::to_world(double px, double py, double& x, double& y) const
+{
+    x = centre_x + (px - pixels_x / 2.) / scale_x();
+    y = centre_y + (py - pixels_y / 2.) / scale_y();
+    x -= std::floor(x);
+    y -= std::floor(y);
+}
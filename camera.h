@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cairo.h>
+
+namespace sg
+{
+    // A view of the unit torus [0, 1)^2 onto a viewport of pixels: the
+    // rectangle of view_width() x view_height() torus units around
+    // (x(), y()).
+    //
+    // Drawing goes through offsets from the centre rather than torus
+    // coordinates, apply() sets cairo up for them. An object near the seam
+    // has copies on either side; each_copy() hands out those that overlap
+    // the view and nothing for an object out of sight, so the caller
+    // spends no cairo call on it. A view wider than half the torus may
+    // see two copies of an object, a smaller one sees one at most.
+    struct camera
+    {
+        // the whole torus onto a 1x1 viewport
+        camera();
+
+        // torus units across the viewport, in (0, 1]
+        void view(double width, double height);
+        // pixels
+        void viewport(int width, int height);
+        // the centre of the view, on the torus
+        void look_at(double x, double y);
+
+        double x() const;
+        double y() const;
+        double view_width() const;
+        double view_height() const;
+        // pixels per torus unit
+        double scale_x() const;
+        double scale_y() const;
+        // from the centre to a corner: a spatial_grid query with this
+        // radius, plus the size of the objects, covers the view
+        double radius() const;
+
+        // Replaces the matrix of cr: user space becomes torus units from
+        // the centre, the centre being the middle of the viewport.
+        void apply(cairo_t* cr) const;
+
+        // the pixel of the copy of (x, y) nearest to the centre
+        void to_screen(double x, double y, double& px, double& py) const;
+        // the torus point under pixel (px, py)
+        void to_world(double px, double py, double& x, double& y) const;
+
+        // Calls f(dx, dy) for the copies of the circle of radius r around
+        // (x, y) that overlap the view, (dx, dy) being the copy's offset
+        // from the centre; x and y in [0, 1].
+        template <typename F>
+        void each_copy(double x, double y, double r, F&& f) const
+        {
+            each_offset(offset(centre_x, x), offset(centre_y, y), r, f);
+        }
+
+        // each_copy() for an offset from the centre in [-0.5, 0.5], as
+        // spatial_grid::query() hands them out
+        template <typename F>
+        void each_offset(double dx, double dy, double r, F&& f) const
+        {
+            double reach_x = half_width + r;
+            double reach_y = half_height + r;
+            for (int i = -1; i <= 1; ++i)
+            {
+                double ox = dx + i;
+                if (ox <= -reach_x || ox >= reach_x)
+                    continue;
+                for (int j = -1; j <= 1; ++j)
+                {
+                    double oy = dy + j;
+                    if (oy > -reach_y && oy < reach_y)
+                        f(ox, oy);
+                }
+            }
+        }
+
+    private:
+        // torus_delta() for a and b in [0, 1], without a floor
+        static double offset(double a, double b)
+        {
+            double d = b - a;
+            if (d > 0.5)
+                return d - 1.;
+            if (d < -0.5)
+                return d + 1.;
+            return d;
+        }
+
+        double centre_x;
+        double centre_y;
+        double half_width;
+        double half_height;
+        int pixels_x;
+        int pixels_y;
+    };
+}
@@ -0,0 +1,242 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <cairo.h>
+
+using namespace sg;
+
+namespace
+{
+    bool ends_with(std::string const& s, char const* suffix)
+    {
+        size_t n = std::strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    // BT.601, limited range
+    uint8_t luma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    uint8_t chroma_u(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    uint8_t chroma_v(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+capture_writer::capture_writer(std::string path, uint32_t fps)
+    : path(std::move(path))
+    , y4m(ends_with(this->path, ".y4m"))
+    , fps(fps)
+    , stream(nullptr)
+    , stream_width(0)
+    , stream_height(0)
+    , submitted(0)
+    , written_(0)
+    , dropped_(0)
+    , stopping(false)
+{
+    if (y4m)
+    {
+        stream = std::fopen(this->path.c_str(), "wb");
+        if (!stream)
+        {
+            std::stringstream ss;
+            ss << "failed to open " << this->path << " for capture: " << std::strerror(errno);
+            throw std::runtime_error(ss.str());
+        }
+    }
+
+    for (frame& f : frames)
+        free_frames.push_back(&f);
+
+    writer = std::thread([this] { write_main(); });
+}
+
+capture_writer::~capture_writer()
+{
+    close();
+}
+
+void capture_writer::close()
+{
+    if (!writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    writer.join();
+
+    if (stream)
+    {
+        std::fclose(stream);
+        stream = nullptr;
+    }
+}
+
+bool capture_writer::submit(uint32_t width, uint32_t height, uint8_t const* bgra, size_t stride)
+{
+    frame* f;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_frames.empty())
+        {
+            ++dropped_;
+            return false;
+        }
+        f = free_frames.back();
+        free_frames.pop_back();
+    }
+
+    // allocates only while the frames grow
+    f->index = ++submitted;
+    f->width = width;
+    f->height = height;
+    f->pixels.resize(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y != height; ++y)
+        std::memcpy(&f->pixels[static_cast<size_t>(y) * width * 4], bgra + y * stride, width * 4);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(f);
+    }
+    wake.notify_one();
+    return true;
+}
+
+void capture_writer::drop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++dropped_;
+}
+
+size_t capture_writer::written() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return written_;
+}
+
+size_t capture_writer::dropped() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped_;
+}
+
+void capture_writer::write_main()
+{
+    bool reported = false;
+    for (;;)
+    {
+        frame* f;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queued.empty(); });
+            // queued frames are written before stopping
+            if (queued.empty())
+                return;
+
+            f = queued.front();
+            queued.pop_front();
+        }
+
+        bool ok = y4m ? write_y4m(*f) : write_png(*f);
+        if (!ok && !reported)
+        {
+            std::clog << "sg: failed to write captured frame " << f->index << " to " << path << std::endl;
+            reported = true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            ++written_;
+        else
+            ++dropped_;
+        free_frames.push_back(f);
+    }
+}
+
+bool capture_writer::write_png(frame const& f)
+{
+    std::stringstream name;
+    name << path;
+    name.width(6);
+    name.fill('0');
+    name << f.index << ".png";
+
+    // cairo only reads the pixels
+    cairo_surface_t* s = cairo_image_surface_create_for_data(
+        const_cast<uint8_t*>(f.pixels.data()), CAIRO_FORMAT_ARGB32, f.width, f.height, f.width * 4);
+    bool ok = cairo_surface_status(s) == CAIRO_STATUS_SUCCESS
+           && cairo_surface_write_to_png(s, name.str().c_str()) == CAIRO_STATUS_SUCCESS;
+    cairo_surface_destroy(s);
+    return ok;
+}
+
+bool capture_writer::write_y4m(frame& f)
+{
+    if (stream_width == 0)
+    {
+        stream_width = f.width;
+        stream_height = f.height;
+        std::fprintf(stream, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", stream_width, stream_height, fps);
+    }
+
+    if (f.width != stream_width || f.height != stream_height)
+        return false;
+
+    uint32_t w = f.width;
+    uint32_t h = f.height;
+    uint32_t cw = (w + 1) / 2;
+    uint32_t ch = (h + 1) / 2;
+    planes.resize(static_cast<size_t>(w) * h + 2 * static_cast<size_t>(cw) * ch);
+    uint8_t* py = planes.data();
+    uint8_t* pu = py + static_cast<size_t>(w) * h;
+    uint8_t* pv = pu + static_cast<size_t>(cw) * ch;
+
+    // premultiplied over black is what the window shows
+    for (uint32_t y = 0; y != h; ++y)
+    {
+        uint8_t const* row = &f.pixels[static_cast<size_t>(y) * w * 4];
+        for (uint32_t x = 0; x != w; ++x)
+            py[static_cast<size_t>(y) * w + x] = luma(row[4 * x + 2], row[4 * x + 1], row[4 * x]);
+    }
+
+    // chroma of the average of 2x2 pixels, edges repeated
+    for (uint32_t y = 0; y != ch; ++y)
+        for (uint32_t x = 0; x != cw; ++x)
+        {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for (uint32_t dy = 0; dy != 2; ++dy)
+                for (uint32_t dx = 0; dx != 2; ++dx)
+                {
+                    uint32_t sx = std::min(2 * x + dx, w - 1);
+                    uint32_t sy = std::min(2 * y + dy, h - 1);
+                    uint8_t const* p = &f.pixels[(static_cast<size_t>(sy) * w + sx) * 4];
+                    r += p[2];
+                    g += p[1];
+                    b += p[0];
+                }
+            pu[static_cast<size_t>(y) * cw + x] = chroma_u(r / 4, g / 4, b / 4);
+            pv[static_cast<size_t>(y) * cw + x] = chroma_v(r / 4, g / 4, b / 4);
+        }
+
+    return std::fputs("FRAME\n", stream) >= 0
+        && std::fwrite(planes.data(), 1, planes.size(), stream) == planes.size();
+}
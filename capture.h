@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sg
+{
+    // Writes captured frames to disk on a thread of its own.
+    //
+    // A path ending in ".y4m" is a single YUV4MPEG2 stream (4:2:0, the
+    // size of the first frame; frames of another size are dropped), any
+    // other path is the prefix of a PNG sequence: path000001.png, ...
+    //
+    // submit() copies the frame into one of a few buffers and returns at
+    // once. When the disk falls behind and every buffer still waits for
+    // the writer, the frame is dropped rather than the caller blocked.
+    struct capture_writer
+    {
+        static constexpr size_t buffer_count = 4;
+
+        // fps goes into the Y4M header
+        capture_writer(std::string path, uint32_t fps);
+
+        capture_writer(capture_writer const&) = delete;
+        capture_writer& operator=(capture_writer const&) = delete;
+
+        // close()s
+        ~capture_writer();
+
+        // writes the frames submitted so far and stops the writer, submit()
+        // must not be called any more
+        void close();
+
+        // bgra is premultiplied 8 bit BGRA as cairo and GL_BGRA store it,
+        // top row first; false if the frame was dropped
+        bool submit(uint32_t width, uint32_t height, uint8_t const* bgra, size_t stride);
+
+        // the caller dropped a frame before submitting it, e.g. because
+        // the GPU readback was late
+        void drop();
+
+        size_t written() const;
+        size_t dropped() const;
+
+    private:
+        struct frame
+        {
+            uint64_t index;
+            uint32_t width;
+            uint32_t height;
+            std::vector<uint8_t> pixels; // stride width * 4
+        };
+
+        void write_main();
+        bool write_png(frame const& f);
+        bool write_y4m(frame& f);
+
+    private:
+        std::string path;
+        bool y4m;
+        uint32_t fps;
+        std::FILE* stream;
+        uint32_t stream_width;
+        uint32_t stream_height;
+        std::vector<uint8_t> planes; // Y4M conversion, writer thread only
+
+        frame frames[buffer_count];
+        uint64_t submitted;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<frame*> free_frames;
+        std::deque<frame*> queued;
+        size_t written_;
+        size_t dropped_;
+        bool stopping;
+        std::thread writer;
+    };
+}
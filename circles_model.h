@@ -0,0 +1,166 @@
+#pragma once
+
+#include "simple_game_window.h"
+#include "ecs.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+struct circles_model : sg::model
+{
+    struct position
+    {
+        float x;
+        float y;
+    };
+
+    struct velocity
+    {
+        float vx;
+        float vy;
+    };
+
+    struct color
+    {
+        float r;
+        float g;
+        float b;
+    };
+
+    circles_model(sg::context& ctx)
+        : sg::model(ctx)
+#if !SG_HAS_COROUTINES
+        , spawn_timer(sg::timer_wheel::null_timer())
+#endif
+        , circle_count(ctx.counter("circles"))
+    {
+        gen();
+        gen();
+        gen();
+        world.commit();
+#if SG_HAS_COROUTINES
+        spawner = spawn();
+#else
+        spawn_timer = ctx.timers().every(std::chrono::milliseconds(1500), [this] { gen(); });
+#endif
+    }
+
+#if !SG_HAS_COROUTINES
+    ~circles_model()
+    {
+        ctx().timers().cancel(spawn_timer);
+    }
+#endif
+
+    void draw(draw_params const& p)
+    {
+        cairo_t* cr = cairo_create(p.surface);
+
+        cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+        cairo_paint(cr);
+        cairo_scale(cr, ctx().width(), ctx().height());
+
+        double ft = p.frame_time * 0.001;
+        world.commit();
+        circle_count = world.count<position>();
+
+        world.each_chunk<position, velocity>([&](size_t n, sg::ecs::entity const*, position* pos, velocity* v)
+        {
+            ctx().jobs().parallel_for(0, n, 4096, [=](size_t first, size_t last)
+            {
+                for (size_t i = first; i != last; ++i)
+                {
+                    pos[i].x += v[i].vx * ft;
+                    pos[i].y += v[i].vy * ft;
+                    if (pos[i].x <= circle_radius)
+                    {
+                        v[i].vx = std::abs(v[i].vx);
+                    }
+                    else if (pos[i].x >= (1 - circle_radius))
+                    {
+                        v[i].vx = -std::abs(v[i].vx);
+                    }
+                    if (pos[i].y <= circle_radius)
+                    {
+                        v[i].vy = std::abs(v[i].vy);
+                    }
+                    else if (pos[i].y >= (1 - circle_radius))
+                    {
+                        v[i].vy = -std::abs(v[i].vy);
+                    }
+                }
+            });
+        });
+
+        cairo_set_line_width (cr, 0.006);
+
+        world.each_chunk<position, color>([cr](size_t n, sg::ecs::entity const*, position const* pos, color const* c)
+        {
+            for (size_t i = 0; i != n; ++i)
+            {
+                cairo_arc(cr, pos[i].x, pos[i].y, circle_radius, 0.0, 2 * 3.1415);
+                cairo_set_source_rgb(cr, c[i].r, c[i].g, c[i].b);
+                cairo_fill_preserve(cr);
+                cairo_set_source_rgb(cr, 0., 0., 0.);
+                cairo_stroke (cr);
+            }
+        });
+
+        cairo_surface_flush(p.surface);
+        cairo_destroy(cr);
+    }
+
+private:
+#if SG_HAS_COROUTINES
+    sg::script spawn()
+    {
+        using namespace std::chrono_literals;
+
+        for (;;)
+        {
+            co_await ctx().sleep(1.5s);
+            gen();
+        }
+    }
+#endif
+
+    void gen()
+    {
+        position pos;
+        pos.x = circle_radius + ctx().random().uniform() * (1 - 2. * circle_radius);
+        pos.y = circle_radius + ctx().random().uniform() * (1 - 2. * circle_radius);
+
+        velocity v;
+        float norm = ctx().random().uniform();
+        float arg = ctx().random().uniform() * 2 * 3.141592;
+        v.vx = norm * cos(arg);
+        v.vy = norm * sin(arg);
+
+        color c;
+        c.r = ctx().random().uniform();
+        c.g = ctx().random().uniform();
+        c.b = ctx().random().uniform();
+        world.create(pos, v, c);
+    }
+
+    void key_down(key_down_params const& p)
+    {
+        if (p.key == SDLK_q)
+            ctx().quit();
+        else if (p.key == SDLK_f)
+            ctx().toggle_fullscreen();
+        else
+            sg::model::key_down(p);
+    }
+
+private:
+    static constexpr float circle_radius = 0.04f;
+    sg::ecs::registry world;
+#if SG_HAS_COROUTINES
+    // declared after world, stops before world goes away
+    sg::script spawner;
+#else
+    sg::timer_wheel::timer_id spawn_timer;
+#endif
+    int64_t& circle_count;
+};
@@ -0,0 +1,570 @@
+#pragma once
+
+#include "job_system.h"
+#include "pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sg
+{
+    // Archetype based entity-component storage.
+    //
+    // Entities with the same set of components share an archetype, which
+    // keeps one contiguous array per component (structure of arrays).
+    // Queries visit every archetype that has the requested components and
+    // hand out those arrays, so systems are linear loops over plain data.
+    //
+    // Components must be trivially copyable; at most 64 component types
+    // exist per program. create() and destroy() only record what to do,
+    // commit() does it after the systems finished: arrays obtained by a
+    // query stay valid and alive(), get() and queries see the same world
+    // until then, also from systems running in parallel. The order of
+    // rows created by parallel systems depends on timing.
+    namespace ecs
+    {
+        typedef uint64_t component_mask;
+
+        inline uint32_t next_component_id()
+        {
+            static uint32_t next = 0;
+            return next++;
+        }
+
+        template <typename C>
+        uint32_t component_id()
+        {
+            static uint32_t const id = next_component_id();
+            assert(id < 64);
+            return id;
+        }
+
+        template <typename... Cs>
+        component_mask components()
+        {
+            component_mask mask = 0;
+            int expand[] = {0, (mask |= component_mask(1) << component_id<Cs>(), 0)...};
+            (void)expand;
+            return mask;
+        }
+
+        struct location
+        {
+            uint32_t archetype;
+            uint32_t row;
+        };
+
+        typedef pool<location>::handle entity;
+
+        struct archetype
+        {
+            struct column
+            {
+                uint32_t component;
+                size_t element_size;
+                std::vector<unsigned char> data;
+                std::vector<unsigned char> staged;
+            };
+
+            explicit archetype(component_mask mask)
+                : mask(mask)
+            {
+                std::fill(std::begin(column_index), std::end(column_index), -1);
+            }
+
+            template <typename C>
+            void add_column()
+            {
+                static_assert(std::is_trivially_copyable<C>::value, "components must be trivially copyable");
+                static_assert(alignof(C) <= alignof(std::max_align_t), "over-aligned components are not supported");
+
+                column_index[component_id<C>()] = static_cast<int8_t>(columns.size());
+                columns.push_back(column{component_id<C>(), sizeof(C), {}, {}});
+            }
+
+            template <typename C>
+            C* data()
+            {
+                int8_t i = column_index[component_id<C>()];
+                return i < 0 ? nullptr : reinterpret_cast<C*>(columns[i].data.data());
+            }
+
+            template <typename C>
+            C* get(location loc)
+            {
+                C* column = data<C>();
+                return column ? column + loc.row : nullptr;
+            }
+
+            size_t size() const
+            {
+                return entities.size();
+            }
+
+            component_mask mask;
+            int8_t column_index[64];
+            std::vector<column> columns;
+            std::vector<entity> entities;
+            size_t staged_rows = 0;
+        };
+
+        struct registry
+        {
+            registry()
+            {}
+
+            registry(registry const&) = delete;
+            registry& operator=(registry const&) = delete;
+
+            // Preallocates room for n entities with exactly the components
+            // Cs, so that creating up to n of them does not allocate.
+            template <typename... Cs>
+            void reserve(size_t n)
+            {
+                archetype& arch = find_or_add_archetype<Cs...>(archetypes);
+                for (archetype::column& c : arch.columns)
+                {
+                    c.data.reserve(n * c.element_size);
+                    c.staged.reserve(n * c.element_size);
+                }
+                arch.entities.reserve(n);
+                pending_destroy.reserve(pending_destroy.capacity() + n);
+            }
+
+            // The entity is created by the next commit(), which gives it a
+            // handle. Safe to call from systems running in parallel.
+            template <typename... Cs>
+            void create(Cs const&... values)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                archetype& arch = find_or_add_archetype<Cs...>(added_archetypes);
+                ++arch.staged_rows;
+                append_staged(arch, values...);
+            }
+
+            // The entity stays alive() until the next commit() removes it,
+            // destroying it again before then does nothing. Safe to call
+            // from systems running in parallel.
+            void destroy(entity e)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending_destroy.push_back(e);
+            }
+
+            bool alive(entity e) const
+            {
+                return entities.alive(e);
+            }
+
+            template <typename C>
+            C* get(entity e)
+            {
+                location* loc = entities.get(e);
+                return loc ? archetypes[loc->archetype]->get<C>(*loc) : nullptr;
+            }
+
+            // Calls f(n, entity const*, C1*, C2*, ...) for every archetype
+            // that has all of Cs, with the arrays of its n entities.
+            // Entities destroyed since the last commit are still in the
+            // arrays.
+            template <typename... Cs, typename F>
+            void each_chunk(F&& f)
+            {
+                component_mask mask = components<Cs...>();
+                for (size_t i = 0; i != archetypes.size(); ++i)
+                {
+                    archetype& arch = *archetypes[i];
+                    if ((arch.mask & mask) != mask || arch.size() == 0)
+                        continue;
+
+                    f(arch.size(), arch.entities.data(), arch.data<Cs>()...);
+                }
+            }
+
+            // Calls f(entity, C1&, C2&, ...) for every entity that has all
+            // of Cs, including the ones destroyed since the last commit.
+            template <typename... Cs, typename F>
+            void each(F&& f)
+            {
+                component_mask mask = components<Cs...>();
+                for (size_t i = 0; i != archetypes.size(); ++i)
+                {
+                    archetype& arch = *archetypes[i];
+                    if ((arch.mask & mask) != mask)
+                        continue;
+
+                    std::tuple<Cs*...> columns(arch.data<Cs>()...);
+                    for (size_t row = 0; row != arch.size(); ++row)
+                        f(arch.entities[row], std::get<Cs*>(columns)[row]...);
+                }
+            }
+
+            // committed entities that have any component of mask
+            size_t count_any(component_mask mask) const
+            {
+                size_t result = 0;
+                for (std::unique_ptr<archetype> const& arch : archetypes)
+                    if ((arch->mask & mask) != 0)
+                        result += arch->size();
+                return result;
+            }
+
+            template <typename... Cs>
+            size_t count()
+            {
+                size_t result = 0;
+                each_chunk<Cs...>([&](size_t n, entity const*, Cs*...) {
+                    result += n;
+                });
+                return result;
+            }
+
+            // Applies creations and destructions made since the last
+            // commit, in the order they were made. Not to be called while
+            // systems run.
+            void commit()
+            {
+                for (entity e : pending_destroy)
+                {
+                    location* loc = entities.get(e);
+                    if (!loc)
+                        continue;
+
+                    location removed = *loc;
+                    entities.despawn(e);
+                    remove_row(removed);
+                }
+                pending_destroy.clear();
+                entities.commit();
+
+                for (std::unique_ptr<archetype>& arch : added_archetypes)
+                    archetypes.push_back(std::move(arch));
+                added_archetypes.clear();
+
+                for (uint32_t a = 0; a != archetypes.size(); ++a)
+                {
+                    archetype& arch = *archetypes[a];
+                    if (arch.staged_rows == 0)
+                        continue;
+
+                    uint32_t first = static_cast<uint32_t>(arch.entities.size());
+                    for (archetype::column& c : arch.columns)
+                    {
+                        c.data.insert(c.data.end(), c.staged.begin(), c.staged.end());
+                        c.staged.clear();
+                    }
+                    for (uint32_t i = 0; i != arch.staged_rows; ++i)
+                        arch.entities.push_back(entities.spawn(location{a, first + i}));
+                    arch.staged_rows = 0;
+                }
+                entities.commit();
+            }
+
+            // Destroys every entity immediately, not to be called while
+            // iterating.
+            void clear()
+            {
+                for (std::unique_ptr<archetype>& arch : added_archetypes)
+                    archetypes.push_back(std::move(arch));
+                added_archetypes.clear();
+
+                for (std::unique_ptr<archetype>& arch : archetypes)
+                {
+                    for (archetype::column& c : arch->columns)
+                    {
+                        c.data.clear();
+                        c.staged.clear();
+                    }
+                    arch->entities.clear();
+                    arch->staged_rows = 0;
+                }
+                pending_destroy.clear();
+                entities.clear();
+            }
+
+            // The committed rows as state_size() bytes, for sg::snapshot:
+            // per archetype its row count and the rows there is room for,
+            // then every column with room for as many rows as are
+            // reserved, so that the bytes of a row stay
+            // at the same place while the count changes. load_state()
+            // takes what save_state() wrote while the registry had the
+            // same archetypes; the entities come back with new handles.
+            // Neither is to be called between create() or destroy() and
+            // commit().
+            size_t state_size() const
+            {
+                size_t size = 0;
+                for (std::unique_ptr<archetype> const& arch : archetypes)
+                {
+                    size += 2 * sizeof(uint64_t);
+                    for (archetype::column const& c : arch->columns)
+                        size += state_rows(*arch) * c.element_size;
+                }
+                return size;
+            }
+
+            void save_state(unsigned char* out) const
+            {
+                assert(pending_destroy.empty());
+                for (std::unique_ptr<archetype> const& arch : archetypes)
+                {
+                    assert(arch->staged_rows == 0);
+                    uint64_t rows[2] = {arch->size(), state_rows(*arch)};
+                    std::memcpy(out, rows, sizeof(rows));
+                    out += sizeof(rows);
+                    for (archetype::column const& c : arch->columns)
+                    {
+                        size_t used = c.data.size();
+                        size_t room = rows[1] * c.element_size;
+                        if (used != 0)
+                            std::memcpy(out, c.data.data(), used);
+                        std::memset(out + used, 0, room - used);
+                        out += room;
+                    }
+                }
+            }
+
+            void load_state(unsigned char const* in, size_t size)
+            {
+                unsigned char const* end = in + size;
+                clear();
+                for (uint32_t a = 0; a != archetypes.size(); ++a)
+                {
+                    archetype& arch = *archetypes[a];
+                    uint64_t rows[2];
+                    std::memcpy(rows, in, sizeof(rows));
+                    in += sizeof(rows);
+                    for (archetype::column& c : arch.columns)
+                    {
+                        c.data.assign(in, in + rows[0] * c.element_size);
+                        in += rows[1] * c.element_size;
+                    }
+                    for (uint32_t row = 0; row != rows[0]; ++row)
+                        arch.entities.push_back(entities.spawn(location{a, row}));
+                }
+                entities.commit();
+                assert(in == end);
+                (void)end;
+            }
+
+        private:
+            static size_t state_rows(archetype const& arch)
+            {
+                return std::max(arch.entities.size(), arch.entities.capacity());
+            }
+
+            // a new archetype goes to added_archetypes while systems may
+            // be iterating, and joins the others at commit()
+            template <typename... Cs>
+            archetype& find_or_add_archetype(std::vector<std::unique_ptr<archetype>>& to)
+            {
+                component_mask mask = components<Cs...>();
+                for (std::unique_ptr<archetype>& arch : archetypes)
+                    if (arch->mask == mask)
+                        return *arch;
+                for (std::unique_ptr<archetype>& arch : added_archetypes)
+                    if (arch->mask == mask)
+                        return *arch;
+
+                std::unique_ptr<archetype> arch(new archetype(mask));
+                int expand[] = {0, (arch->add_column<Cs>(), 0)...};
+                (void)expand;
+                to.push_back(std::move(arch));
+                return *to.back();
+            }
+
+            template <typename... Cs>
+            void append_staged(archetype& arch, Cs const&... values)
+            {
+                int expand[] = {0, (append_staged_one(arch, values), 0)...};
+                (void)expand;
+            }
+
+            template <typename C>
+            void append_staged_one(archetype& arch, C const& value)
+            {
+                std::vector<unsigned char>& bytes = arch.columns[arch.column_index[component_id<C>()]].staged;
+                unsigned char const* p = reinterpret_cast<unsigned char const*>(&value);
+                bytes.insert(bytes.end(), p, p + sizeof(C));
+            }
+
+            // swap-and-pop of a row, the moved entity's location follows
+            void remove_row(location loc)
+            {
+                archetype& arch = *archetypes[loc.archetype];
+                std::vector<entity>& rows = arch.entities;
+                size_t last = rows.size() - 1;
+
+                for (archetype::column& c : arch.columns)
+                {
+                    if (loc.row != last)
+                        std::memcpy(c.data.data() + loc.row * c.element_size,
+                                    c.data.data() + last * c.element_size,
+                                    c.element_size);
+                    c.data.resize(last * c.element_size);
+                }
+
+                if (loc.row != last)
+                {
+                    rows[loc.row] = rows[last];
+                    entities.get(rows[loc.row])->row = loc.row;
+                }
+                rows.pop_back();
+            }
+
+        private:
+            std::mutex mutex;
+            pool<location> entities;
+            std::vector<std::unique_ptr<archetype>> archetypes;
+            std::vector<std::unique_ptr<archetype>> added_archetypes;
+            std::vector<entity> pending_destroy;
+        };
+
+        // Which components a system reads and which it writes.
+        struct access
+        {
+            component_mask reads;
+            component_mask writes;
+
+            bool conflicts(access const& other) const
+            {
+                return (writes & (other.reads | other.writes)) != 0
+                    || (other.writes & reads) != 0;
+            }
+        };
+
+        // Systems run in the order they were added, except that systems
+        // whose access does not conflict are grouped into one stage and may
+        // run in parallel.
+        struct schedule
+        {
+            typedef std::function<void (registry&)> system_func;
+
+            // a stage over fewer entities runs on the calling thread, where
+            // its systems cost less than handing them to workers
+            static constexpr size_t default_parallel_threshold = 1024;
+
+            schedule()
+                : current(nullptr)
+                , threshold(default_parallel_threshold)
+            {}
+
+            void add(char const* name, access a, system_func f)
+            {
+                size_t stage = 0;
+                for (system const& s : systems)
+                    if (s.a.conflicts(a))
+                        stage = std::max(stage, s.stage + 1);
+
+                systems.push_back(system{name, a, std::move(f), stage});
+                stage_count = std::max(stage_count, stage + 1);
+                graphs.clear();
+            }
+
+            size_t stages() const
+            {
+                return stage_count;
+            }
+
+            // the entity count below which run(registry&, job_system&)
+            // keeps a stage on the calling thread
+            void parallel_threshold(size_t entities)
+            {
+                threshold = entities;
+            }
+
+            // Runs every system of every stage on the calling thread, in
+            // stage order.
+            void run(registry& r)
+            {
+                for (size_t stage = 0; stage != stage_count; ++stage)
+                    run_inline(r, stage);
+            }
+
+            // Runs the stages in order, the systems of a stage in parallel
+            // on jobs. A stage of one system, or one whose systems touch
+            // fewer entities than the parallel threshold, runs on the
+            // calling thread instead.
+            void run(registry& r, job_system& jobs)
+            {
+                if (graphs.empty())
+                    build_graphs();
+
+                for (size_t stage = 0; stage != stage_count; ++stage)
+                {
+                    stage_graph& g = graphs[stage];
+                    if (g.systems < 2 || r.count_any(g.touches) < threshold)
+                    {
+                        run_inline(r, stage);
+                        continue;
+                    }
+
+                    current = &r;
+                    jobs.run(*g.tasks);
+                    current = nullptr;
+                }
+            }
+
+        private:
+            struct system
+            {
+                char const* name;
+                access a;
+                system_func f;
+                size_t stage;
+            };
+
+            struct stage_graph
+            {
+                std::unique_ptr<task_graph> tasks;
+                size_t systems;
+                component_mask touches;
+            };
+
+            void run_inline(registry& r, size_t stage)
+            {
+                for (system& s : systems)
+                    if (s.stage == stage)
+                        s.f(r);
+            }
+
+            void build_graphs()
+            {
+                graphs.resize(stage_count);
+                for (stage_graph& g : graphs)
+                {
+                    g.tasks.reset(new task_graph);
+                    g.systems = 0;
+                    g.touches = 0;
+                }
+
+                for (system& s : systems)
+                {
+                    stage_graph& g = graphs[s.stage];
+                    system* p = &s;
+                    g.tasks->add([this, p] { p->f(*current); });
+                    ++g.systems;
+                    g.touches |= s.a.reads | s.a.writes;
+                }
+            }
+
+            std::vector<system> systems;
+            size_t stage_count = 0;
+            std::vector<stage_graph> graphs;
+            registry* current;
+            size_t threshold;
+        };
+    }
+}
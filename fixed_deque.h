@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+
+namespace sg
+{
+    // Double-ended queue over a ring of N elements stored inline. Unlike
+    // std::deque it never allocates, pushing into a full queue is a bug.
+    template <typename T, size_t N>
+    struct fixed_deque
+    {
+        fixed_deque()
+            : first(0)
+            , count(0)
+        {}
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        static constexpr size_t capacity()
+        {
+            return N;
+        }
+
+        T& operator[](size_t i)
+        {
+            assert(i < count);
+            return items[(first + i) % N];
+        }
+
+        T const& operator[](size_t i) const
+        {
+            assert(i < count);
+            return items[(first + i) % N];
+        }
+
+        T& front()
+        {
+            return (*this)[0];
+        }
+
+        T& back()
+        {
+            return (*this)[count - 1];
+        }
+
+        void push_back(T const& value)
+        {
+            assert(count < N);
+            items[(first + count) % N] = value;
+            ++count;
+        }
+
+        void pop_front()
+        {
+            assert(count != 0);
+            first = (first + 1) % N;
+            --count;
+        }
+
+        void pop_back()
+        {
+            assert(count != 0);
+            --count;
+        }
+
+        void clear()
+        {
+            first = 0;
+            count = 0;
+        }
+
+    private:
+        std::array<T, N> items;
+        size_t first;
+        size_t count;
+    };
+}
@@ -0,0 +1,72 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace sg;
+
+frame_arena::frame_arena(size_t block_size)
+    : current(0)
+    , offset(0)
+    , used_before_current(0)
+{
+    add_block(block_size);
+}
+
+void* frame_arena::allocate(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+    for (;;)
+    {
+        block& b = blocks[current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(b.data.get());
+        size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (aligned + size <= b.size)
+        {
+            offset = aligned + size;
+            return b.data.get() + aligned;
+        }
+
+        used_before_current += offset;
+        if (current + 1 == blocks.size())
+            add_block(std::max(b.size * 2, size + alignment));
+        ++current;
+        offset = 0;
+    }
+}
+
+void frame_arena::reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = capacity();
+        blocks.clear();
+        add_block(total);
+    }
+
+    current = 0;
+    offset = 0;
+    used_before_current = 0;
+}
+
+size_t frame_arena::used() const
+{
+    return used_before_current + offset;
+}
+
+size_t frame_arena::capacity() const
+{
+    size_t result = 0;
+    for (block const& b : blocks)
+        result += b.size;
+    return result;
+}
+
+void frame_arena::add_block(size_t min_size)
+{
+    block b;
+    b.data.reset(new unsigned char[min_size]);
+    b.size = min_size;
+    blocks.push_back(std::move(b));
+}
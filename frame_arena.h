@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sg
+{
+    // Bump allocator for memory that lives until the end of the frame.
+    // reset() releases everything at once; when a frame outgrew the first
+    // block, the blocks are merged into one large enough for it, so after
+    // warm-up a frame does not touch the heap.
+    struct frame_arena
+    {
+        explicit frame_arena(size_t block_size = 256 * 1024);
+
+        frame_arena(frame_arena const&) = delete;
+        frame_arena& operator=(frame_arena const&) = delete;
+
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        // uninitialized storage for n objects, T must not need destruction
+        template <typename T>
+        T* allocate_array(size_t n)
+        {
+            return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void reset();
+
+        size_t used() const;
+        size_t capacity() const;
+
+    private:
+        struct block
+        {
+            std::unique_ptr<unsigned char[]> data;
+            size_t size;
+        };
+
+        void add_block(size_t min_size);
+
+    private:
+        std::vector<block> blocks;
+        size_t current;
+        size_t offset;
+        size_t used_before_current;
+    };
+
+    // Standard allocator over a frame_arena, for containers that are
+    // rebuilt every frame. deallocate() is a no-op.
+    template <typename T>
+    struct arena_allocator
+    {
+        typedef T value_type;
+
+        arena_allocator(frame_arena& arena)
+            : arena(&arena)
+        {}
+
+        template <typename U>
+        arena_allocator(arena_allocator<U> const& other)
+            : arena(other.arena)
+        {}
+
+        T* allocate(size_t n)
+        {
+            return arena->allocate_array<T>(n);
+        }
+
+        void deallocate(T*, size_t)
+        {}
+
+        template <typename U>
+        bool operator==(arena_allocator<U> const& other) const
+        {
+            return arena == other.arena;
+        }
+
+        template <typename U>
+        bool operator!=(arena_allocator<U> const& other) const
+        {
+            return arena != other.arena;
+        }
+
+        frame_arena* arena;
+    };
+}
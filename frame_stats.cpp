@@ -0,0 +1,84 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <ostream>
+
+using namespace sg;
+
+sample_series::sample_series()
+    : sum(0.)
+{}
+
+void sample_series::add(double value)
+{
+    samples.push_back(value);
+    sum += value;
+}
+
+void sample_series::clear()
+{
+    samples.clear();
+    sum = 0.;
+}
+
+void sample_series::reserve(size_t n)
+{
+    samples.reserve(n);
+}
+
+size_t sample_series::size() const
+{
+    return samples.size();
+}
+
+bool sample_series::empty() const
+{
+    return samples.empty();
+}
+
+double sample_series::mean() const
+{
+    if (samples.empty())
+        return 0.;
+
+    return sum / samples.size();
+}
+
+double sample_series::max() const
+{
+    if (samples.empty())
+        return 0.;
+
+    return *std::max_element(samples.begin(), samples.end());
+}
+
+double sample_series::percentile(double p)
+{
+    assert(p >= 0. && p <= 1.);
+
+    if (samples.empty())
+        return 0.;
+
+    size_t n = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+}
+
+void sg::print_percentiles(std::ostream& os, char const* name, sample_series& s)
+{
+    os << name << ' ';
+    if (s.empty())
+    {
+        os << "n/a";
+        return;
+    }
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(2)
+       << s.percentile(0.5) << '/' << s.percentile(0.99);
+    os.flags(flags);
+    os.precision(precision);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+namespace sg
+{
+    // Samples of one measured quantity collected between two reports.
+    struct sample_series
+    {
+        sample_series();
+
+        void add(double value);
+        void clear();
+        void reserve(size_t n);
+
+        size_t size() const;
+        bool empty() const;
+        double mean() const;
+        double max() const;
+
+        // p in [0, 1]; reorders the collected samples
+        double percentile(double p);
+
+    private:
+        std::vector<double> samples;
+        double sum;
+    };
+
+    // Prints "name p50/p99" or "name n/a" when nothing was collected.
+    void print_percentiles(std::ostream& os, char const* name, sample_series& s);
+}
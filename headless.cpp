@@ -0,0 +1,141 @@
+#include "headless.h"
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace sg;
+
+namespace
+{
+    cairo_surface_t* create_surface(cairo_format_t format, uint32_t width, uint32_t height)
+    {
+        if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_RGB16_565)
+        {
+            std::stringstream ss;
+            ss << "unsupported pixel format " << format;
+            throw std::runtime_error(ss.str());
+        }
+
+        cairo_surface_t* result = cairo_image_surface_create(format, width, height);
+        if (cairo_surface_status(result) != CAIRO_STATUS_SUCCESS)
+        {
+            std::stringstream ss;
+            ss << "failed to create cairo image surface: "
+               << cairo_status_to_string(cairo_surface_status(result));
+            cairo_surface_destroy(result);
+            throw std::runtime_error(ss.str());
+        }
+        return result;
+    }
+}
+
+headless::headless(win_params const& p)
+    : asset_budget(p.asset_budget_)
+    , jobs(p.workers_, p.pin_workers_)
+    // no device: images stay cairo image surfaces
+    , loader(nullptr, (size_t)p.asset_memory_ << 20, 2)
+    , ctx(nullptr, p.width_, p.height_, p.seed_, &jobs, &loader, p.model_creation_func_, *p.model_type_)
+    , pixel_format(p.pixel_format_)
+    , surface_(create_surface(pixel_format, p.width_, p.height_))
+{
+    try
+    {
+        model = ctx.create_model();
+    }
+    catch (...)
+    {
+        cairo_surface_destroy(surface_);
+        throw;
+    }
+}
+
+headless::~headless()
+{
+    model.reset();
+    cairo_surface_destroy(surface_);
+}
+
+void headless::frame(uint32_t frame_time)
+{
+    ctx.apply_restart(model);
+    ctx.timers_.advance(timer_wheel::duration(frame_time));
+    loader.update(asset_budget);
+
+    sg::model::draw_params dp = {
+        frame_time,
+        surface_,
+        &arena
+    };
+    model->draw(dp);
+    arena.reset();
+}
+
+void headless::key_down(SDL_Keycode key, Uint16 mod)
+{
+    model::key_down_params kdp;
+    kdp.key = key;
+    kdp.mod = mod;
+    model->key_down(kdp);
+}
+
+void headless::key_up(SDL_Keycode key, Uint16 mod)
+{
+    model::key_up_params kup;
+    kup.key = key;
+    kup.mod = mod;
+    model->key_up(kup);
+}
+
+void headless::resize(uint32_t width, uint32_t height)
+{
+    model::resize_params rp;
+    rp.width = width;
+    rp.height = height;
+    rp.old_width = ctx.tex_width;
+    rp.old_height = ctx.tex_height;
+
+    if (width != ctx.tex_width || height != ctx.tex_height)
+    {
+        cairo_surface_t* resized = create_surface(pixel_format, width, height);
+        cairo_surface_destroy(surface_);
+        surface_ = resized;
+        ctx.tex_width = width;
+        ctx.tex_height = height;
+    }
+
+    model->resize(rp);
+}
+
+void headless::apply(input_event const& e)
+{
+    switch (e.type)
+    {
+    case input_event::type_t::frame:
+        frame(e.frame_time);
+        break;
+    case input_event::type_t::key_down:
+        key_down(e.key, e.mod);
+        break;
+    case input_event::type_t::key_up:
+        key_up(e.key, e.mod);
+        break;
+    case input_event::type_t::resize:
+        resize(e.width, e.height);
+        break;
+    }
+}
+
+bool headless::quit_requested() const
+{
+    return ctx.should_quit;
+}
+
+cairo_surface_t* headless::surface() const
+{
+    return surface_;
+}
+
+sg::model& headless::get_model() const
+{
+    return *model;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "simple_game_window.h"
+#include "input_log.h"
+
+namespace sg
+{
+    // Drives the model of win_params without a window: every frame is drawn
+    // into a cairo image surface of the requested size and pixel format,
+    // frame times and input are supplied by the caller. Used for benchmarks
+    // and replays.
+    struct headless
+    {
+        explicit headless(win_params const&);
+
+        headless(headless const&) = delete;
+        headless& operator=(headless const&) = delete;
+
+        ~headless();
+
+        void frame(uint32_t frame_time);
+        void key_down(SDL_Keycode key, Uint16 mod = 0);
+        void key_up(SDL_Keycode key, Uint16 mod = 0);
+        void resize(uint32_t width, uint32_t height);
+        void apply(input_event const& e);
+
+        bool quit_requested() const;
+        cairo_surface_t* surface() const;
+        sg::model& get_model() const;
+
+    private:
+        sg::assets::duration asset_budget;
+        job_system jobs;
+        sg::assets loader;
+        context ctx;
+        frame_arena arena;
+        cairo_format_t pixel_format;
+        cairo_surface_t* surface_;
+        std::unique_ptr<sg::model> model;
+    };
+}
@@ -0,0 +1,137 @@
+#include "input_log.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+using namespace sg;
+
+namespace
+{
+    char const magic[4] = {'S', 'G', 'I', 'N'};
+    constexpr uint64_t format_version = 1;
+
+    char const frame_tag = 'f';
+    char const key_down_tag = 'd';
+    char const key_up_tag = 'u';
+    char const resize_tag = 'r';
+
+    void throw_io_error(char const* what, std::string const& path)
+    {
+        std::stringstream ss;
+        ss << what << " " << path;
+        throw std::runtime_error(ss.str());
+    }
+}
+
+input_recorder::input_recorder(std::string const& path, uint64_t seed)
+    : out(path, std::ios::binary | std::ios::trunc)
+{
+    if (!out)
+        throw_io_error("failed to create input recording", path);
+
+    out.write(magic, sizeof magic);
+    put_varint(format_version);
+    put_varint(seed);
+}
+
+void input_recorder::write(input_event const& e)
+{
+    switch (e.type)
+    {
+    case input_event::type_t::frame:
+        out.put(frame_tag);
+        put_varint(e.frame_time);
+        break;
+    case input_event::type_t::key_down:
+    case input_event::type_t::key_up:
+        out.put(e.type == input_event::type_t::key_down ? key_down_tag : key_up_tag);
+        put_varint(static_cast<uint32_t>(e.key));
+        put_varint(e.mod);
+        break;
+    case input_event::type_t::resize:
+        out.put(resize_tag);
+        put_varint(e.width);
+        put_varint(e.height);
+        break;
+    }
+}
+
+void input_recorder::put_varint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.put(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+}
+
+input_replayer::input_replayer(std::string const& path)
+    : in(path, std::ios::binary)
+{
+    if (!in)
+        throw_io_error("failed to open input recording", path);
+
+    char header[sizeof magic];
+    if (!in.read(header, sizeof header)
+     || !std::equal(std::begin(header), std::end(header), std::begin(magic)))
+        throw_io_error("not an input recording:", path);
+
+    if (get_varint() != format_version)
+        throw_io_error("unsupported version of input recording", path);
+
+    seed_ = get_varint();
+}
+
+uint64_t input_replayer::seed() const
+{
+    return seed_;
+}
+
+bool input_replayer::read(input_event& e)
+{
+    char tag;
+    if (!in.get(tag))
+        return false;
+
+    switch (tag)
+    {
+    case frame_tag:
+        e.type = input_event::type_t::frame;
+        e.frame_time = static_cast<uint32_t>(get_varint());
+        break;
+    case key_down_tag:
+    case key_up_tag:
+        e.type = tag == key_down_tag ? input_event::type_t::key_down : input_event::type_t::key_up;
+        e.key = static_cast<SDL_Keycode>(static_cast<uint32_t>(get_varint()));
+        e.mod = static_cast<Uint16>(get_varint());
+        break;
+    case resize_tag:
+        e.type = input_event::type_t::resize;
+        e.width = static_cast<uint32_t>(get_varint());
+        e.height = static_cast<uint32_t>(get_varint());
+        break;
+    default:
+        throw std::runtime_error("corrupted input recording");
+    }
+
+    return true;
+}
+
+uint64_t input_replayer::get_varint()
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        char c;
+        if (!in.get(c))
+            throw std::runtime_error("truncated input recording");
+
+        result |= static_cast<uint64_t>(static_cast<unsigned char>(c) & 0x7f) << shift;
+        if (!(c & 0x80))
+            return result;
+    }
+    throw std::runtime_error("corrupted input recording");
+}
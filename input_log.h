@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <SDL2/SDL_keycode.h>
+
+namespace sg
+{
+    // Everything that reaches a model from outside besides its random
+    // seed. Replaying the events of a recording against the same seed
+    // reproduces the recorded session frame for frame.
+    struct input_event
+    {
+        enum class type_t : uint8_t
+        {
+            frame,
+            key_down,
+            key_up,
+            resize,
+        };
+
+        type_t type;
+        uint32_t frame_time; // frame
+        SDL_Keycode key;     // key_down, key_up
+        Uint16 mod;          // key_down, key_up
+        uint32_t width;      // resize
+        uint32_t height;     // resize
+    };
+
+    // Writes the seed and the input events of a session to a compact binary
+    // file: a tag byte per event followed by LEB128 encoded fields.
+    struct input_recorder
+    {
+        input_recorder(std::string const& path, uint64_t seed);
+
+        input_recorder(input_recorder const&) = delete;
+        input_recorder& operator=(input_recorder const&) = delete;
+
+        void write(input_event const& e);
+
+    private:
+        void put_varint(uint64_t value);
+
+    private:
+        std::ofstream out;
+    };
+
+    struct input_replayer
+    {
+        explicit input_replayer(std::string const& path);
+
+        input_replayer(input_replayer const&) = delete;
+        input_replayer& operator=(input_replayer const&) = delete;
+
+        uint64_t seed() const;
+
+        // false when the recording is over
+        bool read(input_event& e);
+
+    private:
+        uint64_t get_varint();
+
+    private:
+        std::ifstream in;
+        uint64_t seed_;
+    };
+}
@@ -0,0 +1,302 @@
+#include "job_system.h"
+#include "fixed_deque.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace sg;
+
+namespace
+{
+    // the pool and queue of the calling thread if it is a worker
+    thread_local job_system const* current_pool = nullptr;
+    thread_local size_t current_queue = 0;
+
+    // chunks per thread of a parallel_for, some slack for uneven chunks
+    constexpr size_t chunks_per_thread = 4;
+}
+
+task_graph::task_graph()
+{}
+
+task_graph::task_id task_graph::add(std::function<void ()> f)
+{
+    nodes.emplace_back();
+    node& n = nodes.back();
+    n.f = std::move(f);
+    n.predecessors = 0;
+    n.pending = 0;
+    return nodes.size() - 1;
+}
+
+void task_graph::precede(task_id before, task_id after)
+{
+    assert(before < nodes.size() && after < nodes.size() && before != after);
+    nodes[before].successors.push_back(after);
+    ++nodes[after].predecessors;
+}
+
+size_t task_graph::size() const
+{
+    return nodes.size();
+}
+
+struct job_system::queue
+{
+    queue()
+        : busy_ns(0)
+    {}
+
+    std::mutex mutex;
+    // a push into a full queue runs the job inline instead
+    fixed_deque<job, 1024> jobs;
+    std::atomic<uint64_t> busy_ns;
+};
+
+struct job_system::graph_run
+{
+    job_system* pool;
+    task_graph* graph;
+    std::atomic<size_t>* remaining;
+};
+
+job_system::job_system(size_t worker_count, bool pin)
+    : queued(0)
+    , sleeping(0)
+    , waiting(0)
+    , stopping(false)
+{
+    for (size_t i = 0; i != worker_count + 1; ++i)
+        queues.emplace_back(new queue);
+
+    for (size_t i = 0; i != worker_count; ++i)
+        workers.emplace_back(&job_system::worker_main, this, i, pin);
+}
+
+job_system::~job_system()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& t : workers)
+        t.join();
+}
+
+size_t job_system::worker_count() const
+{
+    return workers.size();
+}
+
+void job_system::run(task_graph& g)
+{
+    if (g.nodes.empty())
+        return;
+
+    std::atomic<size_t> remaining(g.nodes.size());
+    graph_run gr = {this, &g, &remaining};
+
+    for (task_graph::node& n : g.nodes)
+        n.pending = n.predecessors;
+
+    for (size_t i = 0; i != g.nodes.size(); ++i)
+        if (g.nodes[i].predecessors == 0)
+            push(job{&run_graph_task, &gr, i, 0, &remaining});
+
+    wait(remaining);
+}
+
+uint64_t job_system::busy_ns(size_t worker) const
+{
+    assert(worker < workers.size());
+    return queues[worker + 1]->busy_ns.load(std::memory_order_relaxed);
+}
+
+size_t job_system::default_worker_count()
+{
+    // the thread that owns the window works too while it waits
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 1 ? n - 1 : 0;
+}
+
+void job_system::run_graph_task(void* data, size_t task, size_t)
+{
+    graph_run& gr = *static_cast<graph_run*>(data);
+    task_graph::node& n = gr.graph->nodes[task];
+
+    n.f();
+
+    // successors are queued before this task counts as finished, so the
+    // waiting thread cannot return while one is still to be started
+    for (task_graph::task_id s : n.successors)
+        if (gr.graph->nodes[s].pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            gr.pool->push(job{&run_graph_task, data, s, 0, gr.remaining});
+}
+
+void job_system::parallel_for(size_t begin, size_t end, size_t grain, job_func f, void* data)
+{
+    if (begin >= end)
+        return;
+
+    size_t n = end - begin;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = std::min((n + grain - 1) / grain, (workers.size() + 1) * chunks_per_thread);
+    if (chunks <= 1)
+    {
+        f(data, begin, end);
+        return;
+    }
+
+    size_t chunk_size = (n + chunks - 1) / chunks;
+    std::atomic<size_t> remaining(0);
+    for (size_t first = begin + chunk_size; first < end; first += chunk_size)
+    {
+        remaining.fetch_add(1, std::memory_order_relaxed);
+        push(job{f, data, first, std::min(first + chunk_size, end), &remaining});
+    }
+
+    f(data, begin, begin + chunk_size);
+    wait(remaining);
+}
+
+void job_system::push(job const& j)
+{
+    size_t home = current_pool == this ? current_queue : 0;
+    queue& q = *queues[home];
+
+    {
+        std::unique_lock<std::mutex> lock(q.mutex);
+        if (q.jobs.size() == q.jobs.capacity())
+        {
+            lock.unlock();
+            execute(j);
+            return;
+        }
+        q.jobs.push_back(j);
+    }
+
+    queued.fetch_add(1);
+    bool workers_asleep = sleeping.load() != 0;
+    bool waiters_asleep = waiting.load() != 0;
+    if (workers_asleep || waiters_asleep)
+    {
+        // a thread between checking queued and waiting holds sleep_mutex
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        if (workers_asleep)
+            wake.notify_one();
+        if (waiters_asleep)
+            progress.notify_all();
+    }
+}
+
+bool job_system::try_pop(size_t home, job& j)
+{
+    // own queue newest first, that is what the cache still has
+    {
+        queue& q = *queues[home];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.jobs.empty())
+        {
+            j = q.jobs.back();
+            q.jobs.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // others oldest first, those are the largest pieces of work
+    for (size_t i = 1; i != queues.size(); ++i)
+    {
+        queue& q = *queues[(home + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.jobs.empty())
+        {
+            j = q.jobs.front();
+            q.jobs.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void job_system::execute(job const& j)
+{
+    j.f(j.data, j.begin, j.end);
+
+    // the waiter may return as soon as remaining is 0, j.remaining is not
+    // to be touched after
+    if (j.remaining->fetch_sub(1) == 1 && waiting.load() != 0)
+    {
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        progress.notify_all();
+    }
+}
+
+void job_system::wait(std::atomic<size_t>& remaining)
+{
+    size_t home = current_pool == this ? current_queue : 0;
+    job j;
+    while (remaining.load() != 0)
+    {
+        if (try_pop(home, j))
+        {
+            execute(j);
+            continue;
+        }
+
+        // the rest runs on other threads: sleep until it finished or
+        // there is something to help with
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        waiting.fetch_add(1);
+        progress.wait(lock, [&] { return remaining.load() == 0 || queued.load() != 0; });
+        waiting.fetch_sub(1);
+    }
+}
+
+void job_system::worker_main(size_t index, bool pin)
+{
+    typedef std::chrono::steady_clock clock;
+
+    current_pool = this;
+    current_queue = index + 1;
+
+    if (pin)
+    {
+        unsigned cpus = std::max(std::thread::hardware_concurrency(), 1u);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((index + 1) % cpus, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            std::clog << "sg: failed to pin worker " << index << " to CPU " << (index + 1) % cpus << std::endl;
+    }
+
+    queue& own = *queues[current_queue];
+    job j;
+    for (;;)
+    {
+        if (try_pop(current_queue, j))
+        {
+            clock::time_point start = clock::now();
+            execute(j);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+            own.busy_ns.fetch_add(ns, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this] { return queued.load() != 0 || stopping; });
+        sleeping.fetch_sub(1);
+        if (stopping && queued.load() == 0)
+            return;
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sg
+{
+    struct job_system;
+
+    // Tasks with dependencies, built once and run by job_system::run() as
+    // often as needed. A task starts when all tasks preceding it finished.
+    struct task_graph
+    {
+        typedef size_t task_id;
+
+        task_graph();
+
+        task_graph(task_graph const&) = delete;
+        task_graph& operator=(task_graph const&) = delete;
+
+        task_id add(std::function<void ()> f);
+        // after does not start before before finished
+        void precede(task_id before, task_id after);
+
+        size_t size() const;
+
+    private:
+        struct node
+        {
+            std::function<void ()> f;
+            std::vector<task_id> successors;
+            size_t predecessors;
+            std::atomic<size_t> pending;
+        };
+
+        std::deque<node> nodes;
+
+        friend struct job_system;
+    };
+
+    // Work-stealing thread pool. Every worker has its own queue and steals
+    // from the others when it runs dry; a thread waiting for its jobs
+    // (parallel_for(), run()) executes queued jobs meanwhile and sleeps
+    // when there are none, so nesting is fine and a pool without workers
+    // runs everything on the caller.
+    //
+    // Scheduling does not allocate. Jobs must not throw.
+    struct job_system
+    {
+        // pin: worker i is bound to CPU (i + 1) modulo the CPU count,
+        // leaving CPU 0 to the thread that owns the window
+        job_system(size_t workers, bool pin);
+
+        job_system(job_system const&) = delete;
+        job_system& operator=(job_system const&) = delete;
+
+        ~job_system();
+
+        size_t worker_count() const;
+
+        // Calls f(first, last) for subranges of [begin, end) of at least
+        // grain elements, in parallel, and returns when all calls returned.
+        template <typename F>
+        void parallel_for(size_t begin, size_t end, size_t grain, F const& f)
+        {
+            parallel_for(begin, end, grain, &invoke_range<F>, const_cast<void*>(static_cast<void const*>(&f)));
+        }
+
+        // Runs every task of g and returns when all finished.
+        void run(task_graph& g);
+
+        // nanoseconds worker i spent running jobs since construction
+        uint64_t busy_ns(size_t worker) const;
+
+        static size_t default_worker_count();
+
+    private:
+        typedef void (*job_func)(void* data, size_t begin, size_t end);
+
+        struct job
+        {
+            job_func f;
+            void* data;
+            size_t begin;
+            size_t end;
+            std::atomic<size_t>* remaining;
+        };
+
+        struct queue;
+        struct graph_run;
+
+        template <typename F>
+        static void invoke_range(void* f, size_t begin, size_t end)
+        {
+            (*static_cast<F const*>(f))(begin, end);
+        }
+
+        static void run_graph_task(void* data, size_t task, size_t);
+
+        void parallel_for(size_t begin, size_t end, size_t grain, job_func f, void* data);
+        void push(job const& j);
+        bool try_pop(size_t home, job& j);
+        void execute(job const& j);
+        void wait(std::atomic<size_t>& remaining);
+        void worker_main(size_t index, bool pin);
+
+    private:
+        // queues[0] is shared by the threads that are not workers, worker
+        // i owns queues[i + 1]
+        std::vector<std::unique_ptr<queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued;
+        std::atomic<size_t> sleeping;
+        // threads in wait() with nothing to run
+        std::atomic<size_t> waiting;
+        std::atomic<bool> stopping;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        // a job finished or was queued while threads are waiting
+        std::condition_variable progress;
+    };
+}
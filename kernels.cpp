@@ -0,0 +1,365 @@
+#include "kernels.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// SSE2 is part of x86-64, AVX2 is checked at runtime
+#if defined(__x86_64__)
+#define SG_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace sg;
+
+namespace
+{
+    double wrap01(double x)
+    {
+        double r = x - std::floor(x);
+        // a tiny negative x rounds up to 1
+        return r < 1. ? r : 0.;
+    }
+
+    void integrate_wrap_scalar(double* p, double const* v, size_t n, double k)
+    {
+        for (size_t i = 0; i != n; ++i)
+            p[i] = wrap01(p[i] + v[i] * k);
+    }
+
+    size_t expire_scalar(double* t, size_t n, double dt, uint32_t* expired)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i != n; ++i)
+        {
+            t[i] -= dt;
+            if (t[i] < 0.)
+                expired[count++] = static_cast<uint32_t>(i);
+        }
+        return count;
+    }
+
+    // edge j from (ax, ay) along (ex, ey), inv is 1 / |e|^2
+    struct polygon_edges
+    {
+        polygon_edges(double const* px, double const* py, size_t m)
+            : m(m)
+        {
+            assert(m <= kernel_set::max_polygon);
+            for (size_t j = 0; j != m; ++j)
+            {
+                size_t next = j + 1 != m ? j + 1 : 0;
+                ax[j] = px[j];
+                ay[j] = py[j];
+                ex[j] = px[next] - px[j];
+                ey[j] = py[next] - py[j];
+                inv[j] = 1. / (ex[j] * ex[j] + ey[j] * ey[j]);
+            }
+        }
+
+        size_t m;
+        double ax[kernel_set::max_polygon];
+        double ay[kernel_set::max_polygon];
+        double ex[kernel_set::max_polygon];
+        double ey[kernel_set::max_polygon];
+        double inv[kernel_set::max_polygon];
+    };
+
+    // the vector versions clamp t and compare in the same order, with
+    // max(t, 0) being t > 0 ? t : 0 as maxpd has it
+    size_t polygon_hits_scalar(polygon_edges const& edges, double const* cx, double const* cy,
+                               double const* r, size_t n, uint32_t* hits)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i != n; ++i)
+        {
+            double r2 = r[i] * r[i];
+            bool hit = false;
+            for (size_t j = 0; j != edges.m; ++j)
+            {
+                double wx = cx[i] - edges.ax[j];
+                double wy = cy[i] - edges.ay[j];
+                double t = (wx * edges.ex[j] + wy * edges.ey[j]) * edges.inv[j];
+                t = t > 0. ? t : 0.;
+                t = t < 1. ? t : 1.;
+                double dx = wx - t * edges.ex[j];
+                double dy = wy - t * edges.ey[j];
+                hit = hit || dx * dx + dy * dy <= r2;
+            }
+            if (hit)
+                hits[count++] = static_cast<uint32_t>(i);
+        }
+        return count;
+    }
+
+    size_t polygon_hits_scalar(double const* px, double const* py, size_t m,
+                               double const* cx, double const* cy, double const* r, size_t n,
+                               uint32_t* hits)
+    {
+        return polygon_hits_scalar(polygon_edges(px, py, m), cx, cy, r, n, hits);
+    }
+
+#ifdef SG_X86
+    // SSE2 has no floor: rounds through the 2^52 trick, exact for every
+    // double (beyond 2^52 x is an integer already) and keeping the sign of
+    // a zero as std::floor does
+    __m128d floor_sse2(__m128d x)
+    {
+        __m128d const sign_bit = _mm_set1_pd(-0.);
+        __m128d const big = _mm_set1_pd(4503599627370496.); // 2^52
+        __m128d const one = _mm_set1_pd(1.);
+
+        __m128d sign = _mm_and_pd(x, sign_bit);
+        __m128d magnitude = _mm_andnot_pd(sign_bit, x);
+        __m128d m = _mm_or_pd(big, sign);
+        __m128d r = _mm_or_pd(_mm_sub_pd(_mm_add_pd(x, m), m), sign);
+        r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, x), one));
+
+        __m128d integral = _mm_cmpge_pd(magnitude, big);
+        return _mm_or_pd(_mm_and_pd(integral, x), _mm_andnot_pd(integral, r));
+    }
+
+    __m128d wrap01_sse2(__m128d x)
+    {
+        __m128d r = _mm_sub_pd(x, floor_sse2(x));
+        return _mm_and_pd(r, _mm_cmplt_pd(r, _mm_set1_pd(1.)));
+    }
+
+    void integrate_wrap_sse2(double* p, double const* v, size_t n, double k)
+    {
+        __m128d kk = _mm_set1_pd(k);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128d a = _mm_add_pd(_mm_loadu_pd(p + i), _mm_mul_pd(_mm_loadu_pd(v + i), kk));
+            __m128d b = _mm_add_pd(_mm_loadu_pd(p + i + 2), _mm_mul_pd(_mm_loadu_pd(v + i + 2), kk));
+            _mm_storeu_pd(p + i, wrap01_sse2(a));
+            _mm_storeu_pd(p + i + 2, wrap01_sse2(b));
+        }
+        integrate_wrap_scalar(p + i, v + i, n - i, k);
+    }
+
+    size_t expire_sse2(double* t, size_t n, double dt, uint32_t* expired)
+    {
+        __m128d d = _mm_set1_pd(dt);
+        __m128d zero = _mm_setzero_pd();
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128d x = _mm_sub_pd(_mm_loadu_pd(t + i), d);
+            _mm_storeu_pd(t + i, x);
+            int mask = _mm_movemask_pd(_mm_cmplt_pd(x, zero));
+            // bullets rarely expire, most masks are empty
+            if (mask == 0)
+                continue;
+            if (mask & 1)
+                expired[count++] = static_cast<uint32_t>(i);
+            if (mask & 2)
+                expired[count++] = static_cast<uint32_t>(i + 1);
+        }
+        size_t tail = expire_scalar(t + i, n - i, dt, expired + count);
+        for (size_t j = count; j != count + tail; ++j)
+            expired[j] += static_cast<uint32_t>(i);
+        return count + tail;
+    }
+
+    size_t polygon_hits_sse2(double const* px, double const* py, size_t m,
+                             double const* cx, double const* cy, double const* r, size_t n,
+                             uint32_t* hits)
+    {
+        polygon_edges edges(px, py, m);
+        __m128d zero = _mm_setzero_pd();
+        __m128d one = _mm_set1_pd(1.);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128d x = _mm_loadu_pd(cx + i);
+            __m128d y = _mm_loadu_pd(cy + i);
+            __m128d rr = _mm_loadu_pd(r + i);
+            __m128d r2 = _mm_mul_pd(rr, rr);
+            __m128d hit = zero;
+            for (size_t j = 0; j != edges.m; ++j)
+            {
+                __m128d ex = _mm_set1_pd(edges.ex[j]);
+                __m128d ey = _mm_set1_pd(edges.ey[j]);
+                __m128d wx = _mm_sub_pd(x, _mm_set1_pd(edges.ax[j]));
+                __m128d wy = _mm_sub_pd(y, _mm_set1_pd(edges.ay[j]));
+                __m128d t = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(wx, ex), _mm_mul_pd(wy, ey)), _mm_set1_pd(edges.inv[j]));
+                t = _mm_min_pd(_mm_max_pd(t, zero), one);
+                __m128d dx = _mm_sub_pd(wx, _mm_mul_pd(t, ex));
+                __m128d dy = _mm_sub_pd(wy, _mm_mul_pd(t, ey));
+                __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+                hit = _mm_or_pd(hit, _mm_cmple_pd(d2, r2));
+            }
+            int mask = _mm_movemask_pd(hit);
+            for (; mask != 0; mask &= mask - 1)
+                hits[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+        size_t tail = polygon_hits_scalar(edges, cx + i, cy + i, r + i, n - i, hits + count);
+        for (size_t j = count; j != count + tail; ++j)
+            hits[j] += static_cast<uint32_t>(i);
+        return count + tail;
+    }
+
+    // without "fma" the compiler cannot fuse p + v * k, which would round
+    // differently from the other sets
+    __attribute__((target("avx2")))
+    __m256d wrap01_avx2(__m256d x)
+    {
+        __m256d r = _mm256_sub_pd(x, _mm256_round_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+        return _mm256_and_pd(r, _mm256_cmp_pd(r, _mm256_set1_pd(1.), _CMP_LT_OQ));
+    }
+
+    __attribute__((target("avx2")))
+    void integrate_wrap_avx2(double* p, double const* v, size_t n, double k)
+    {
+        __m256d kk = _mm256_set1_pd(k);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256d a = _mm256_add_pd(_mm256_loadu_pd(p + i), _mm256_mul_pd(_mm256_loadu_pd(v + i), kk));
+            __m256d b = _mm256_add_pd(_mm256_loadu_pd(p + i + 4), _mm256_mul_pd(_mm256_loadu_pd(v + i + 4), kk));
+            _mm256_storeu_pd(p + i, wrap01_avx2(a));
+            _mm256_storeu_pd(p + i + 4, wrap01_avx2(b));
+        }
+        integrate_wrap_sse2(p + i, v + i, n - i, k);
+    }
+
+    __attribute__((target("avx2")))
+    size_t expire_avx2(double* t, size_t n, double dt, uint32_t* expired)
+    {
+        __m256d d = _mm256_set1_pd(dt);
+        __m256d zero = _mm256_setzero_pd();
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d x = _mm256_sub_pd(_mm256_loadu_pd(t + i), d);
+            _mm256_storeu_pd(t + i, x);
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+            for (; mask != 0; mask &= mask - 1)
+                expired[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+        size_t tail = expire_scalar(t + i, n - i, dt, expired + count);
+        for (size_t j = count; j != count + tail; ++j)
+            expired[j] += static_cast<uint32_t>(i);
+        return count + tail;
+    }
+
+    __attribute__((target("avx2")))
+    size_t polygon_hits_avx2(double const* px, double const* py, size_t m,
+                             double const* cx, double const* cy, double const* r, size_t n,
+                             uint32_t* hits)
+    {
+        polygon_edges edges(px, py, m);
+        __m256d zero = _mm256_setzero_pd();
+        __m256d one = _mm256_set1_pd(1.);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d x = _mm256_loadu_pd(cx + i);
+            __m256d y = _mm256_loadu_pd(cy + i);
+            __m256d rr = _mm256_loadu_pd(r + i);
+            __m256d r2 = _mm256_mul_pd(rr, rr);
+            __m256d hit = zero;
+            for (size_t j = 0; j != edges.m; ++j)
+            {
+                __m256d ex = _mm256_set1_pd(edges.ex[j]);
+                __m256d ey = _mm256_set1_pd(edges.ey[j]);
+                __m256d wx = _mm256_sub_pd(x, _mm256_set1_pd(edges.ax[j]));
+                __m256d wy = _mm256_sub_pd(y, _mm256_set1_pd(edges.ay[j]));
+                __m256d t = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(wx, ex), _mm256_mul_pd(wy, ey)),
+                                          _mm256_set1_pd(edges.inv[j]));
+                t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+                __m256d dx = _mm256_sub_pd(wx, _mm256_mul_pd(t, ex));
+                __m256d dy = _mm256_sub_pd(wy, _mm256_mul_pd(t, ey));
+                __m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+                hit = _mm256_or_pd(hit, _mm256_cmp_pd(d2, r2, _CMP_LE_OQ));
+            }
+            int mask = _mm256_movemask_pd(hit);
+            for (; mask != 0; mask &= mask - 1)
+                hits[count++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+        }
+        size_t tail = polygon_hits_scalar(edges, cx + i, cy + i, r + i, n - i, hits + count);
+        for (size_t j = count; j != count + tail; ++j)
+            hits[j] += static_cast<uint32_t>(i);
+        return count + tail;
+    }
+#endif
+
+    kernel_set const scalar_set = {simd::scalar, &integrate_wrap_scalar, &expire_scalar, &polygon_hits_scalar};
+#ifdef SG_X86
+    kernel_set const sse2_set = {simd::sse2, &integrate_wrap_sse2, &expire_sse2, &polygon_hits_sse2};
+    kernel_set const avx2_set = {simd::avx2, &integrate_wrap_avx2, &expire_avx2, &polygon_hits_avx2};
+#endif
+
+    kernel_set const& pick_kernels()
+    {
+        kernel_set const* best = &scalar_set;
+        for (simd level : {simd::sse2, simd::avx2})
+            if (kernel_set const* k = kernels(level))
+                best = k;
+
+        char const* wanted = std::getenv("SG_SIMD");
+        if (!wanted)
+            return *best;
+
+        for (simd level : {simd::scalar, simd::sse2, simd::avx2})
+        {
+            if (std::strcmp(wanted, simd_name(level)) != 0)
+                continue;
+            if (kernel_set const* k = kernels(level))
+                return *k;
+            break;
+        }
+        std::clog << "sg: SG_SIMD=" << wanted << " is not available, using "
+                  << simd_name(best->level) << std::endl;
+        return *best;
+    }
+}
+
+kernel_set const* sg::kernels(simd level)
+{
+#ifdef SG_X86
+    // may run from a static constructor, before the runtime did it
+    __builtin_cpu_init();
+#endif
+    switch (level)
+    {
+    case simd::scalar:
+        return &scalar_set;
+#ifdef SG_X86
+    case simd::sse2:
+        return __builtin_cpu_supports("sse2") ? &sse2_set : nullptr;
+    case simd::avx2:
+        return __builtin_cpu_supports("avx2") ? &avx2_set : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+kernel_set const& sg::kernels()
+{
+    static kernel_set const& active = pick_kernels();
+    return active;
+}
+
+char const* sg::simd_name(simd level)
+{
+    switch (level)
+    {
+    case simd::scalar:
+        return "scalar";
+    case simd::sse2:
+        return "sse2";
+    case simd::avx2:
+        return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sg
+{
+    // Batch kernels over flat arrays of doubles, as ecs columns of plain
+    // structs of doubles are.
+    //
+    // Every instruction set computes bit for bit what the scalar reference
+    // does, so a replay stays the same from one machine to another; the
+    // vector versions only do it more elements at a time. The best set the
+    // CPU supports is picked at startup, SG_SIMD=scalar|sse2|avx2 asks for
+    // another one.
+    enum class simd
+    {
+        scalar,
+        sse2,
+        avx2,
+    };
+
+    struct kernel_set
+    {
+        simd level;
+
+        // p[i] = wrap01(p[i] + v[i] * k) for i in [0, n), wrap01 being
+        // x - floor(x) with 1 folded back onto 0
+        void (*integrate_wrap)(double* p, double const* v, size_t n, double k);
+
+        // t[i] -= dt for i in [0, n); writes the indices where t[i] < 0
+        // to expired in ascending order and returns their count,
+        // expired has room for n
+        size_t (*expire)(double* t, size_t n, double dt, uint32_t* expired);
+
+        static constexpr size_t max_polygon = 8;
+
+        // Circle i at (cx[i], cy[i]) with radius r[i] against the closed
+        // polygon of the m <= max_polygon points (px, py): writes the
+        // indices of the circles within r[i] of an edge to hits in
+        // ascending order and returns their count, hits has room for n.
+        // A polygon inside a circle touches it, a circle inside the
+        // polygon does not. The edges are set up once per call.
+        size_t (*polygon_hits)(double const* px, double const* py, size_t m,
+                               double const* cx, double const* cy, double const* r, size_t n,
+                               uint32_t* hits);
+    };
+
+    // nullptr if the CPU lacks level
+    kernel_set const* kernels(simd level);
+
+    // the set picked at startup
+    kernel_set const& kernels();
+
+    char const* simd_name(simd level);
+}
@@ -0,0 +1,485 @@
+// Runs sg::run() and sg::run<M>() against a scripted stand-in for SDL, GL
+// and cairo-gl: a model that logs its calls is driven through live,
+// recorded and replayed sessions, and both loops have to call it the same
+// way and record the same file. A replay has to call it as the recorded
+// session did, whatever live input and window sizes come in meanwhile.
+//
+// The stand-in functions are defined here and take the place of the
+// libraries' for libsg, cairo image surfaces replace the GL ones.
+
+#include "simple_game_window.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_syswm.h>
+
+#include <cairo-gl.h>
+#include <GL/glu.h>
+
+namespace
+{
+    struct scripted_event
+    {
+        uint32_t at; // ms of the virtual clock
+        SDL_Event event;
+    };
+
+    // what the stand-in feeds the loop, and the clock it runs on
+    struct stand_in_state
+    {
+        std::vector<scripted_event> script;
+        size_t next = 0;
+        // sends SDL_QUIT once the script is over, a replay ends by itself
+        bool quit_when_done = true;
+        uint32_t now = 1000;
+        int window_width = 0;
+        int window_height = 0;
+    };
+
+    stand_in_state stand_in;
+
+    int dummy_window;
+    int dummy_contexts[2];
+    size_t contexts_created;
+    int dummy_device;
+
+    SDL_Event key_event(uint32_t type, SDL_Keycode key)
+    {
+        SDL_Event e;
+        std::memset(&e, 0, sizeof e);
+        e.type = type;
+        e.key.keysym.sym = key;
+        return e;
+    }
+
+    SDL_Event resize_event(int width, int height)
+    {
+        SDL_Event e;
+        std::memset(&e, 0, sizeof e);
+        e.type = SDL_WINDOWEVENT;
+        e.window.event = SDL_WINDOWEVENT_RESIZED;
+        e.window.data1 = width;
+        e.window.data2 = height;
+        return e;
+    }
+}
+
+int SDL_Init(Uint32)
+{
+    return 0;
+}
+
+void SDL_Quit()
+{}
+
+char const* SDL_GetError()
+{
+    return "stand-in";
+}
+
+SDL_Window* SDL_CreateWindow(char const*, int, int, int w, int h, Uint32)
+{
+    stand_in.window_width = w;
+    stand_in.window_height = h;
+    return reinterpret_cast<SDL_Window*>(&dummy_window);
+}
+
+void SDL_DestroyWindow(SDL_Window*)
+{}
+
+void SDL_GetWindowSize(SDL_Window*, int* w, int* h)
+{
+    *w = stand_in.window_width;
+    *h = stand_in.window_height;
+}
+
+void SDL_SetWindowSize(SDL_Window*, int w, int h)
+{
+    stand_in.window_width = w;
+    stand_in.window_height = h;
+}
+
+Uint32 SDL_GetWindowFlags(SDL_Window*)
+{
+    return SDL_WINDOW_OPENGL;
+}
+
+int SDL_SetWindowFullscreen(SDL_Window*, Uint32)
+{
+    return 0;
+}
+
+SDL_bool SDL_GetWindowWMInfo(SDL_Window*, SDL_SysWMinfo* info)
+{
+    std::memset(&info->info, 0, sizeof info->info);
+    return SDL_TRUE;
+}
+
+SDL_GLContext SDL_GL_CreateContext(SDL_Window*)
+{
+    return &dummy_contexts[contexts_created++ % 2];
+}
+
+void SDL_GL_DeleteContext(SDL_GLContext)
+{}
+
+int SDL_GL_MakeCurrent(SDL_Window*, SDL_GLContext)
+{
+    return 0;
+}
+
+// no timer queries, no pixel buffer objects
+SDL_bool SDL_GL_ExtensionSupported(char const*)
+{
+    return SDL_FALSE;
+}
+
+void* SDL_GL_GetProcAddress(char const*)
+{
+    return nullptr;
+}
+
+int SDL_GL_SetAttribute(SDL_GLattr, int)
+{
+    return 0;
+}
+
+void SDL_GL_SwapWindow(SDL_Window*)
+{}
+
+char const* SDL_GetKeyName(SDL_Keycode)
+{
+    return "key";
+}
+
+Uint32 SDL_GetTicks()
+{
+    return stand_in.now;
+}
+
+// The next scripted event if it is due within timeout, moving the clock
+// to it, else the clock moves by timeout.
+int SDL_WaitEventTimeout(SDL_Event* event, int timeout)
+{
+    stand_in_state& s = stand_in;
+    if (s.next != s.script.size() && s.script[s.next].at <= s.now + timeout)
+    {
+        s.now = std::max(s.now, s.script[s.next].at);
+        *event = s.script[s.next++].event;
+        if (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_RESIZED)
+        {
+            s.window_width = event->window.data1;
+            s.window_height = event->window.data2;
+        }
+        return 1;
+    }
+    if (s.next == s.script.size() && s.quit_when_done)
+    {
+        std::memset(event, 0, sizeof *event);
+        event->type = SDL_QUIT;
+        return 1;
+    }
+    s.now += timeout;
+    return 0;
+}
+
+void glEnable(GLenum)
+{}
+
+void glDisable(GLenum)
+{}
+
+void glViewport(GLint, GLint, GLsizei, GLsizei)
+{}
+
+void glClearColor(GLclampf, GLclampf, GLclampf, GLclampf)
+{}
+
+void glClear(GLbitfield)
+{}
+
+void glGetIntegerv(GLenum, GLint* value)
+{
+    *value = 16384;
+}
+
+void glGenTextures(GLsizei n, GLuint* textures)
+{
+    for (GLsizei i = 0; i != n; ++i)
+        textures[i] = i + 1;
+}
+
+void glDeleteTextures(GLsizei, GLuint const*)
+{}
+
+void glBindTexture(GLenum, GLuint)
+{}
+
+void glTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, GLvoid const*)
+{}
+
+void glTexParameterf(GLenum, GLenum, GLfloat)
+{}
+
+void glGetTexImage(GLenum, GLint, GLenum, GLenum, GLvoid*)
+{}
+
+void glMatrixMode(GLenum)
+{}
+
+void glLoadIdentity()
+{}
+
+void gluOrtho2D(GLdouble, GLdouble, GLdouble, GLdouble)
+{}
+
+void glBegin(GLenum)
+{}
+
+void glEnd()
+{}
+
+void glTexCoord2f(GLfloat, GLfloat)
+{}
+
+void glVertex2f(GLfloat, GLfloat)
+{}
+
+void glVertex2i(GLint, GLint)
+{}
+
+cairo_device_t* cairo_glx_device_create(Display*, GLXContext)
+{
+    return reinterpret_cast<cairo_device_t*>(&dummy_device);
+}
+
+// the dummy device is not cairo's, any other is
+void cairo_device_destroy(cairo_device_t* device)
+{
+    if (device == reinterpret_cast<cairo_device_t*>(&dummy_device))
+        return;
+
+    typedef void (*destroy_func)(cairo_device_t*);
+    reinterpret_cast<destroy_func>(dlsym(RTLD_NEXT, "cairo_device_destroy"))(device);
+}
+
+cairo_surface_t* cairo_gl_surface_create(cairo_device_t*, cairo_content_t content, int width, int height)
+{
+    return cairo_image_surface_create(content == CAIRO_CONTENT_COLOR ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+                                      width, height);
+}
+
+cairo_surface_t* cairo_gl_surface_create_for_texture(cairo_device_t* device, cairo_content_t content, unsigned int, int width, int height)
+{
+    return cairo_gl_surface_create(device, content, width, height);
+}
+
+void cairo_gl_surface_swapbuffers(cairo_surface_t*)
+{}
+
+namespace
+{
+    std::vector<std::string>& calls()
+    {
+        static std::vector<std::string> result;
+        return result;
+    }
+
+    // Logs every call the loop makes and the surface it draws into; r
+    // restarts it.
+    struct probe_model : sg::model
+    {
+        probe_model(sg::context& ctx)
+            : model(ctx)
+        {
+            std::ostringstream ss;
+            ss << "create " << ctx.width() << "x" << ctx.height() << " " << ctx.random().next();
+            calls().push_back(ss.str());
+        }
+
+        ~probe_model()
+        {
+            calls().push_back("destroy");
+        }
+
+        void draw(draw_params const& p) override
+        {
+            std::ostringstream ss;
+            ss << "draw " << p.frame_time
+               << " " << cairo_image_surface_get_width(p.surface) << "x" << cairo_image_surface_get_height(p.surface)
+               << " " << ctx().width() << "x" << ctx().height();
+            calls().push_back(ss.str());
+        }
+
+        void key_down(key_down_params const& p) override
+        {
+            calls().push_back("key_down " + std::to_string(p.key));
+            if (p.key == SDLK_r)
+                ctx().restart();
+        }
+
+        void key_up(key_up_params const& p) override
+        {
+            calls().push_back("key_up " + std::to_string(p.key));
+        }
+
+        void resize(resize_params const& p) override
+        {
+            std::ostringstream ss;
+            ss << "resize " << p.old_width << "x" << p.old_height << " to " << p.width << "x" << p.height;
+            calls().push_back(ss.str());
+        }
+    };
+
+    // keys, a restart and resizes, two of them within a frame
+    std::vector<scripted_event> session_script()
+    {
+        return {
+            {1050, key_event(SDL_KEYDOWN, SDLK_a)},
+            {1120, key_event(SDL_KEYUP, SDLK_a)},
+            {1300, resize_event(800, 600)},
+            {1500, resize_event(900, 700)},
+            {1502, resize_event(1024, 768)},
+            {1700, key_event(SDL_KEYDOWN, SDLK_r)},
+            {1710, key_event(SDL_KEYUP, SDLK_r)},
+            {1900, resize_event(400, 300)},
+            {2000, key_event(SDL_KEYDOWN, SDLK_b)},
+            {2040, key_event(SDL_KEYUP, SDLK_b)},
+            {2200, resize_event(640, 480)},
+            {2300, key_event(SDL_KEYDOWN, SDLK_c)},
+        };
+    }
+
+    // live input a replay has to ignore
+    std::vector<scripted_event> replay_noise()
+    {
+        return {
+            {1010, resize_event(300, 200)},
+            {1200, key_event(SDL_KEYDOWN, SDLK_r)},
+            {1210, key_event(SDL_KEYUP, SDLK_r)},
+            {1400, resize_event(1200, 900)},
+            {1800, key_event(SDL_KEYDOWN, SDLK_x)},
+            {1850, resize_event(500, 500)},
+        };
+    }
+
+    enum class loop_kind
+    {
+        virtual_hooks, // sg::run()
+        static_hooks,  // sg::run<M>()
+    };
+
+    std::vector<std::string> run_session(loop_kind kind, std::vector<scripted_event> script, bool quit_when_done,
+                                         std::string const& record, std::string const& replay)
+    {
+        stand_in = stand_in_state();
+        stand_in.script = std::move(script);
+        stand_in.quit_when_done = quit_when_done;
+        calls().clear();
+
+        sg::win_params p;
+        p.width(640)
+         .height(480)
+         .resizing_policy(sg::win_params::resizing_policy_t::scaled)
+         .pixel_format(CAIRO_FORMAT_ARGB32)
+         .min_frame_interval(16)
+         .stats_interval(0)
+         .latency_overlay(false)
+         .stats_shm("")
+         .workers(1)
+         .seed(42)
+         .record(record)
+         .replay(replay)
+         .capture("");
+
+        if (kind == loop_kind::virtual_hooks)
+            sg::run(p.model<probe_model>());
+        else
+            sg::run<probe_model>(p);
+
+        std::ostringstream ss;
+        ss << "window " << stand_in.window_width << "x" << stand_in.window_height;
+        calls().push_back(ss.str());
+        return calls();
+    }
+
+    std::string file_contents(std::string const& path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+
+    bool same_calls(char const* what, std::vector<std::string> const& expected, std::vector<std::string> const& actual)
+    {
+        if (expected == actual)
+            return true;
+
+        size_t i = 0;
+        while (i != expected.size() && i != actual.size() && expected[i] == actual[i])
+            ++i;
+        std::cerr << what << ": call " << i << " is \""
+                  << (i != actual.size() ? actual[i] : "(none)") << "\", expected \""
+                  << (i != expected.size() ? expected[i] : "(none)") << "\"" << std::endl;
+        return false;
+    }
+
+    bool contains(std::vector<std::string> const& calls, std::string const& prefix)
+    {
+        return std::any_of(calls.begin(), calls.end(), [&](std::string const& c)
+        {
+            return c.compare(0, prefix.size(), prefix) == 0;
+        });
+    }
+}
+
+int main()
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string pid = std::to_string(getpid());
+    std::string recorded_virtual = (dir / ("sg_loop_check_" + pid + "_virtual")).string();
+    std::string recorded_static = (dir / ("sg_loop_check_" + pid + "_static")).string();
+
+    bool ok = true;
+
+    std::vector<std::string> live = run_session(loop_kind::virtual_hooks, session_script(), true, recorded_virtual, "");
+    if (!contains(live, "resize 640x480 to 800x600") || !contains(live, "resize 800x600 to 1024x768")
+     || !contains(live, "destroy") || !contains(live, "key_down 97") || !contains(live, "key_up 97"))
+    {
+        std::cerr << "live session: the script did not resize, restart and press keys" << std::endl;
+        ok = false;
+    }
+
+    ok &= same_calls("sg::run<M>", live,
+                     run_session(loop_kind::static_hooks, session_script(), true, recorded_static, ""));
+    if (file_contents(recorded_virtual) != file_contents(recorded_static))
+    {
+        std::cerr << "sg::run<M>: recorded another file than sg::run" << std::endl;
+        ok = false;
+    }
+
+    // a replay quits when the recording is over, after the window took
+    // the recorded sizes again
+    ok &= same_calls("sg::run replay", live,
+                     run_session(loop_kind::virtual_hooks, replay_noise(), false, "", recorded_virtual));
+    ok &= same_calls("sg::run<M> replay", live,
+                     run_session(loop_kind::static_hooks, replay_noise(), false, "", recorded_virtual));
+
+    std::remove(recorded_virtual.c_str());
+    std::remove(recorded_static.c_str());
+
+    std::cout << (ok ? "ok" : "failed") << std::endl;
+    return ok ? 0 : 1;
+}
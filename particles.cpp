@@ -0,0 +1,204 @@
+#include "particles.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace sg;
+
+namespace
+{
+    // levels of alpha render() draws paths at
+    constexpr int path_levels = 4;
+
+    // src is premultiplied, ia is 255 - its alpha; two channels at a time
+    // in the 0x00ff00ff lanes, x / 255 rounded as (x + 128 + (x + 128 >> 8)) >> 8
+    uint32_t over(uint32_t dst, uint32_t src, uint32_t ia)
+    {
+        uint32_t rb = (dst & 0x00ff00ff) * ia + 0x00800080;
+        uint32_t ag = ((dst >> 8) & 0x00ff00ff) * ia + 0x00800080;
+        rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+        ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+        return src + (ag | rb);
+    }
+}
+
+particles::particles(size_t capacity, uint64_t seed)
+    : capacity_(capacity)
+    , size_(0)
+    , dropped_(0)
+    , rnd(seed)
+    , x(capacity)
+    , y(capacity)
+    , vx(capacity)
+    , vy(capacity)
+    , life(capacity)
+    , fade(capacity)
+    , expired(capacity)
+{}
+
+size_t particles::emit(burst const& b, size_t n)
+{
+    assert(b.life_min > 0 && b.life_min <= b.life_max);
+
+    // full bursts up to half the capacity, then thinner and thinner ones
+    size_t room = capacity_ - size_;
+    size_t half = capacity_ / 2;
+    size_t allowed = size_ <= half ? n : n * room / (capacity_ - half);
+    allowed = std::min(allowed, room);
+    dropped_ += n - allowed;
+
+    for (size_t i = 0; i != allowed; ++i, ++size_)
+    {
+        double angle = b.angle + rnd.uniform(-b.spread, b.spread);
+        double speed = rnd.uniform(b.speed_min, b.speed_max);
+        double l = rnd.uniform(b.life_min, b.life_max);
+        x[size_] = b.x;
+        y[size_] = b.y;
+        vx[size_] = b.vx + speed * std::cos(angle);
+        vy[size_] = b.vy + speed * std::sin(angle);
+        life[size_] = l;
+        fade[size_] = 1. / l;
+    }
+    return allowed;
+}
+
+void particles::update(double dt)
+{
+    kernel_set const& k = kernels();
+    k.integrate_wrap(x.data(), vx.data(), size_, dt);
+    k.integrate_wrap(y.data(), vy.data(), size_, dt);
+    size_t count = k.expire(life.data(), size_, dt, expired.data());
+
+    // from the back, so that the particle moved into a hole is never one
+    // that expired too
+    for (size_t j = count; j != 0; --j)
+    {
+        size_t i = expired[j - 1];
+        --size_;
+        x[i] = x[size_];
+        y[i] = y[size_];
+        vx[i] = vx[size_];
+        vy[i] = vy[size_];
+        life[i] = life[size_];
+        fade[i] = fade[size_];
+    }
+}
+
+void particles::clear()
+{
+    size_ = 0;
+}
+
+void particles::render(cairo_t* cr, camera const& view, double size, double r, double g, double b,
+                       size_t path_budget) const
+{
+    if (size_ == 0)
+        return;
+
+    cairo_surface_t* target = cairo_get_target(cr);
+    cairo_matrix_t m;
+    cairo_get_matrix(cr, &m);
+    if (cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE && m.xy == 0. && m.yx == 0.)
+    {
+        cairo_format_t format = cairo_image_surface_get_format(target);
+        cairo_surface_flush(target);
+        uint8_t* pixels = cairo_image_surface_get_data(target);
+        if (pixels && (format == CAIRO_FORMAT_ARGB32 || format == CAIRO_FORMAT_RGB24))
+        {
+            render(pixels, cairo_image_surface_get_width(target), cairo_image_surface_get_height(target),
+                   cairo_image_surface_get_stride(target), format, view, m.xx, m.yy, m.x0, m.y0, size, r, g, b);
+            cairo_surface_mark_dirty(target);
+            return;
+        }
+    }
+
+    // a path per alpha level; beyond the budget every step-th particle
+    // stands for the ones skipped
+    size_t step = std::max<size_t>(1, (size_ + path_budget - 1) / std::max<size_t>(path_budget, 1));
+    cairo_save(cr);
+    for (int level = 0; level != path_levels; ++level)
+    {
+        cairo_new_path(cr);
+        bool any = false;
+        for (size_t i = 0; i < size_; i += step)
+        {
+            int l = std::min(path_levels - 1, static_cast<int>(life[i] * fade[i] * path_levels));
+            if (l != level)
+                continue;
+
+            view.each_copy(x[i], y[i], size / 2, [&](double dx, double dy)
+            {
+                cairo_rectangle(cr, dx - size / 2, dy - size / 2, size, size);
+                any = true;
+            });
+        }
+        if (!any)
+            continue;
+
+        cairo_set_source_rgba(cr, r, g, b, (level + 0.5) / path_levels);
+        cairo_fill(cr);
+    }
+    cairo_restore(cr);
+}
+
+void particles::render(uint8_t* pixels, int width, int height, int stride, cairo_format_t format,
+                       camera const& view, double scale_x, double scale_y, double offset_x, double offset_y,
+                       double size, double r, double g, double b) const
+{
+    assert(format == CAIRO_FORMAT_ARGB32 || format == CAIRO_FORMAT_RGB24);
+    (void)format; // RGB24 ignores the alpha byte written
+
+    int side = std::max(1, static_cast<int>(size * std::min(std::fabs(scale_x), std::fabs(scale_y)) + 0.5));
+    side = std::min(side, std::min(width, height));
+    double half = side / 2.;
+    uint32_t r8 = static_cast<uint32_t>(std::clamp(r, 0., 1.) * 255. + 0.5);
+    uint32_t g8 = static_cast<uint32_t>(std::clamp(g, 0., 1.) * 255. + 0.5);
+    uint32_t b8 = static_cast<uint32_t>(std::clamp(b, 0., 1.) * 255. + 0.5);
+
+    for (size_t i = 0; i != size_; ++i)
+    {
+        uint32_t a = static_cast<uint32_t>(std::clamp(life[i] * fade[i], 0., 1.) * 255. + 0.5);
+        if (a == 0)
+            continue;
+        uint32_t src = a << 24 | (r8 * a + 127) / 255 << 16 | (g8 * a + 127) / 255 << 8 | (b8 * a + 127) / 255;
+
+        view.each_copy(x[i], y[i], size / 2, [&](double dx, double dy)
+        {
+            double fx = dx * scale_x + offset_x - half;
+            double fy = dy * scale_y + offset_y - half;
+            if (!(fx > -side && fx < width && fy > -side && fy < height))
+                return;
+            // truncating a positive value floors without a libm call
+            int px = static_cast<int>(fx + side) - side;
+            int py = static_cast<int>(fy + side) - side;
+            int x0 = std::max(px, 0);
+            int x1 = std::min(px + side, width);
+            int y0 = std::max(py, 0);
+            int y1 = std::min(py + side, height);
+
+            for (int row_y = y0; row_y < y1; ++row_y)
+            {
+                uint32_t* row = reinterpret_cast<uint32_t*>(pixels + static_cast<size_t>(row_y) * stride);
+                for (int col = x0; col < x1; ++col)
+                    row[col] = over(row[col], src, 255 - a);
+            }
+        });
+    }
+}
+
+size_t particles::size() const
+{
+    return size_;
+}
+
+size_t particles::capacity() const
+{
+    return capacity_;
+}
+
+uint64_t particles::dropped() const
+{
+    return dropped_;
+}
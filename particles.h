@@ -0,0 +1,84 @@
+#pragma once
+
+#include "camera.h"
+#include "random.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <cairo.h>
+
+namespace sg
+{
+    // Short lived points on the unit torus [0, 1)^2, for explosions and
+    // exhaust.
+    //
+    // Every attribute is an array of its own, update() runs the kernels of
+    // kernels.h over them and fills the holes of expired particles with
+    // the last ones. The arrays are allocated once for the capacity:
+    // when they fill up, emit() thins bursts out and finally drops them,
+    // and render() thins out the particles it cannot afford to draw.
+    struct particles
+    {
+        // a cone of particles
+        struct burst
+        {
+            double x; // on the unit torus
+            double y;
+            double vx; // added to every particle, per second
+            double vy;
+            double angle; // direction of the cone, radians
+            double spread; // half angle of the cone, pi for all around
+            double speed_min; // per second
+            double speed_max;
+            double life_min; // seconds
+            double life_max;
+        };
+
+        // random streams of the same seed repeat, so do replays
+        explicit particles(size_t capacity, uint64_t seed = 0);
+
+        // Adds up to n particles, fewer once more than half the capacity
+        // is in use; returns how many.
+        size_t emit(burst const& b, size_t n);
+
+        void update(double dt);
+
+        void clear();
+
+        // Draws the particles view sees as squares of size in torus units,
+        // fading with their remaining life; the user space of cr is the
+        // one of view.apply(). Writes the pixels of an image target under
+        // a scale and translation itself, goes through cairo paths
+        // otherwise. At most path_budget particles take the path, evenly
+        // spread over all of them.
+        void render(cairo_t* cr, camera const& view, double size, double r, double g, double b,
+                    size_t path_budget = 20000) const;
+
+        // Draws into premultiplied ARGB32 or RGB24 pixels, the offset
+        // (dx, dy) from the centre of view being pixel (dx * scale_x +
+        // offset_x, dy * scale_y + offset_y); clips at the edges.
+        void render(uint8_t* pixels, int width, int height, int stride, cairo_format_t format,
+                    camera const& view, double scale_x, double scale_y, double offset_x, double offset_y,
+                    double size, double r, double g, double b) const;
+
+        size_t size() const;
+        size_t capacity() const;
+        // particles emit() left out since construction
+        uint64_t dropped() const;
+
+    private:
+        size_t capacity_;
+        size_t size_;
+        uint64_t dropped_;
+        sg::random rnd;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> vx;
+        std::vector<double> vy;
+        std::vector<double> life; // seconds left
+        std::vector<double> fade; // 1 / life at emission
+        std::vector<uint32_t> expired;
+    };
+}
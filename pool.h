@@ -0,0 +1,337 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sg
+{
+    // Object pool with stable generational handles and dense storage.
+    //
+    // Objects are stored contiguously in chunks of ChunkSize, so iterating
+    // over [0, size()) is a linear walk and growing the pool never moves
+    // existing objects. Handles refer to a slot that follows its object
+    // when the storage is compacted; a slot's generation is bumped when its
+    // object goes away, which makes all old handles to it invalid.
+    //
+    // Structural changes are deferred: spawned objects join the iterated
+    // range and despawned objects leave it (and get compacted away) only
+    // at commit(), so references obtained while iterating stay valid
+    // until then. A despawned object is no longer alive() right away.
+    template <typename T, size_t ChunkSize = 256>
+    struct pool
+    {
+        static_assert(ChunkSize != 0 && (ChunkSize & (ChunkSize - 1)) == 0,
+                      "ChunkSize must be a power of two");
+
+        struct handle
+        {
+            uint32_t index;
+            uint32_t generation;
+
+            bool operator==(handle other) const
+            {
+                return index == other.index && generation == other.generation;
+            }
+
+            bool operator!=(handle other) const
+            {
+                return !(*this == other);
+            }
+        };
+
+        static constexpr handle null_handle()
+        {
+            return handle{UINT32_MAX, 0};
+        }
+
+        enum class growth
+        {
+            fixed,   // spawn() fails with null_handle() when full
+            chunked, // a chunk of ChunkSize objects is added when full
+        };
+
+        explicit pool(size_t capacity = ChunkSize, growth policy = growth::chunked)
+            : policy(policy)
+            , free_head(no_slot)
+            , live(0)
+            , count(0)
+        {
+            size_t n = (capacity + ChunkSize - 1) / ChunkSize;
+            for (size_t i = 0; i != n; ++i)
+                chunks.emplace_back(new chunk);
+            slots.reserve(n * ChunkSize);
+            despawned.reserve(n * ChunkSize);
+        }
+
+        pool(pool const&) = delete;
+        pool& operator=(pool const&) = delete;
+
+        ~pool()
+        {
+            for (size_t i = 0; i != count; ++i)
+                item(i).~T();
+        }
+
+        template <typename... Args>
+        handle spawn(Args&&... args)
+        {
+            if (count == chunks.size() * ChunkSize)
+            {
+                if (policy == growth::fixed)
+                    return null_handle();
+
+                chunks.emplace_back(new chunk);
+            }
+
+            uint32_t s = free_head;
+            if (s != no_slot)
+                free_head = slots[s].dense;
+            else
+            {
+                s = static_cast<uint32_t>(slots.size());
+                slots.push_back(slot{0, 0, slot_state::free});
+            }
+
+            new (&item(count)) T(std::forward<Args>(args)...);
+            slot_of(count) = s;
+
+            slot& sl = slots[s];
+            sl.dense = static_cast<uint32_t>(count);
+            sl.state = slot_state::alive;
+            ++count;
+
+            return handle{s, sl.generation};
+        }
+
+        void despawn(handle h)
+        {
+            if (alive(h))
+                mark_despawned(h.index);
+        }
+
+        void despawn_at(size_t i)
+        {
+            assert(i < count);
+            uint32_t s = slot_of(i);
+            if (slots[s].state == slot_state::alive)
+                mark_despawned(s);
+        }
+
+        bool alive(handle h) const
+        {
+            return h.index < slots.size()
+                && slots[h.index].generation == h.generation
+                && slots[h.index].state == slot_state::alive;
+        }
+
+        bool alive_at(size_t i) const
+        {
+            assert(i < count);
+            return slots[slot_of(i)].state == slot_state::alive;
+        }
+
+        // nullptr if h is not alive
+        T* get(handle h)
+        {
+            return alive(h) ? &item(slots[h.index].dense) : nullptr;
+        }
+
+        handle handle_at(size_t i) const
+        {
+            assert(i < count);
+            uint32_t s = slot_of(i);
+            return handle{s, slots[s].generation};
+        }
+
+        T& operator[](size_t i)
+        {
+            assert(i < count);
+            return item(i);
+        }
+
+        T const& operator[](size_t i) const
+        {
+            assert(i < count);
+            return item(i);
+        }
+
+        // number of objects in the iterated range
+        size_t size() const
+        {
+            return live;
+        }
+
+        bool empty() const
+        {
+            return live == 0;
+        }
+
+        // Applies spawns and despawns made since the previous commit.
+        void commit()
+        {
+            for (uint32_t s : despawned)
+            {
+                slot& sl = slots[s];
+                size_t d = sl.dense;
+                size_t last = count - 1;
+
+                if (d != last)
+                {
+                    item(d) = std::move(item(last));
+                    uint32_t moved = slot_of(last);
+                    slot_of(d) = moved;
+                    slots[moved].dense = static_cast<uint32_t>(d);
+                }
+                item(last).~T();
+                --count;
+
+                release(s);
+            }
+            despawned.clear();
+            live = count;
+        }
+
+        // Destroys all objects immediately, must not be called while
+        // iterating.
+        void clear()
+        {
+            for (size_t i = 0; i != count; ++i)
+            {
+                item(i).~T();
+                release(slot_of(i));
+            }
+            despawned.clear();
+            live = 0;
+            count = 0;
+        }
+
+        template <typename P, typename V>
+        struct basic_iterator
+        {
+            V& operator*() const
+            {
+                return (*p)[i];
+            }
+
+            V* operator->() const
+            {
+                return &(*p)[i];
+            }
+
+            basic_iterator& operator++()
+            {
+                ++i;
+                return *this;
+            }
+
+            bool operator==(basic_iterator other) const
+            {
+                return i == other.i;
+            }
+
+            bool operator!=(basic_iterator other) const
+            {
+                return i != other.i;
+            }
+
+            P* p;
+            size_t i;
+        };
+
+        typedef basic_iterator<pool, T> iterator;
+        typedef basic_iterator<pool const, T const> const_iterator;
+
+        iterator begin()
+        {
+            return iterator{this, 0};
+        }
+
+        iterator end()
+        {
+            return iterator{this, live};
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator{this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator{this, live};
+        }
+
+    private:
+        static constexpr uint32_t no_slot = UINT32_MAX;
+
+        enum class slot_state : uint8_t
+        {
+            free,
+            alive,
+            despawned,
+        };
+
+        struct slot
+        {
+            uint32_t generation;
+            uint32_t dense; // next free slot while free
+            slot_state state;
+        };
+
+        struct chunk
+        {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type items[ChunkSize];
+            uint32_t slots[ChunkSize];
+        };
+
+        T& item(size_t i)
+        {
+            return reinterpret_cast<T&>(chunks[i / ChunkSize]->items[i % ChunkSize]);
+        }
+
+        T const& item(size_t i) const
+        {
+            return reinterpret_cast<T const&>(chunks[i / ChunkSize]->items[i % ChunkSize]);
+        }
+
+        uint32_t& slot_of(size_t i)
+        {
+            return chunks[i / ChunkSize]->slots[i % ChunkSize];
+        }
+
+        uint32_t slot_of(size_t i) const
+        {
+            return chunks[i / ChunkSize]->slots[i % ChunkSize];
+        }
+
+        void mark_despawned(uint32_t s)
+        {
+            slots[s].state = slot_state::despawned;
+            despawned.push_back(s);
+        }
+
+        void release(uint32_t s)
+        {
+            slot& sl = slots[s];
+            ++sl.generation;
+            sl.state = slot_state::free;
+            sl.dense = free_head;
+            free_head = s;
+        }
+
+    private:
+        growth policy;
+        std::vector<std::unique_ptr<chunk>> chunks;
+        std::vector<slot> slots;
+        std::vector<uint32_t> despawned;
+        uint32_t free_head;
+        size_t live;
+        size_t count;
+    };
+}
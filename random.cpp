@@ -0,0 +1,76 @@
+#include "random.h"
+
+#include <cassert>
+
+using namespace sg;
+
+namespace
+{
+    uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t splitmix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+}
+
+random::random(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void random::seed(uint64_t value)
+{
+    for (uint64_t& word : s)
+        word = splitmix64(value);
+}
+
+uint64_t random::next()
+{
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+double random::uniform()
+{
+    return (next() >> 11) * (1. / (uint64_t(1) << 53));
+}
+
+double random::uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * uniform();
+}
+
+uint32_t random::below(uint32_t n)
+{
+    assert(n > 0);
+
+    // Lemire's multiply-shift with rejection, unbiased
+    uint64_t m = (next() >> 32) * n;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < n)
+    {
+        uint32_t threshold = -n % n;
+        while (low < threshold)
+        {
+            m = (next() >> 32) * n;
+            low = static_cast<uint32_t>(m);
+        }
+    }
+    return static_cast<uint32_t>(m >> 32);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sg
+{
+    // xoshiro256** generator. Unlike rand() and the std distributions its
+    // output is fully specified, so a seed reproduces the same sequence on
+    // every platform, which replays rely on.
+    struct random
+    {
+        explicit random(uint64_t seed = 0);
+
+        void seed(uint64_t value);
+
+        uint64_t next();
+
+        // uniformly distributed in [0, 1)
+        double uniform();
+        // uniformly distributed in [lo, hi)
+        double uniform(double lo, double hi);
+        // uniformly distributed in [0, n), n > 0
+        uint32_t below(uint32_t n);
+
+    private:
+        uint64_t s[4];
+    };
+}
@@ -1,12 +1,25 @@
 #include "simple_game_window.h"
+#include "alloc_audit.h"
+#include "capture.h"
+#include "frame_stats.h"
+#include "input_log.h"
+#include "stats_publisher.h"
 
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_syswm.h>
@@ -84,6 +97,11 @@ namespace
             return size_type(w, h);
         }
 
+        void set_size(int width, int height)
+        {
+            SDL_SetWindowSize(handle, width, height);
+        }
+
         SDL_Window* get() const
         {
             return handle;
@@ -263,34 +281,690 @@ namespace
         cairo_surface_t* handle;
     };
 
-    void resize_surface(int texture,
+    struct gl_timer_query_functions
+    {
+        gl_timer_query_functions()
+            : supported(false)
+            , gen_queries(nullptr)
+            , delete_queries(nullptr)
+            , begin_query(nullptr)
+            , end_query(nullptr)
+            , get_query_objectiv(nullptr)
+            , get_query_objectui64v(nullptr)
+        {}
+
+        // requires a current GL context
+        void load()
+        {
+            if (!SDL_GL_ExtensionSupported("GL_ARB_timer_query"))
+                return;
+
+            gen_queries = reinterpret_cast<PFNGLGENQUERIESPROC>(SDL_GL_GetProcAddress("glGenQueries"));
+            delete_queries = reinterpret_cast<PFNGLDELETEQUERIESPROC>(SDL_GL_GetProcAddress("glDeleteQueries"));
+            begin_query = reinterpret_cast<PFNGLBEGINQUERYPROC>(SDL_GL_GetProcAddress("glBeginQuery"));
+            end_query = reinterpret_cast<PFNGLENDQUERYPROC>(SDL_GL_GetProcAddress("glEndQuery"));
+            get_query_objectiv = reinterpret_cast<PFNGLGETQUERYOBJECTIVPROC>(SDL_GL_GetProcAddress("glGetQueryObjectiv"));
+            get_query_objectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VPROC>(SDL_GL_GetProcAddress("glGetQueryObjectui64v"));
+
+            supported = gen_queries && delete_queries
+                     && begin_query && end_query
+                     && get_query_objectiv && get_query_objectui64v;
+        }
+
+        bool supported;
+        PFNGLGENQUERIESPROC gen_queries;
+        PFNGLDELETEQUERIESPROC delete_queries;
+        PFNGLBEGINQUERYPROC begin_query;
+        PFNGLENDQUERYPROC end_query;
+        PFNGLGETQUERYOBJECTIVPROC get_query_objectiv;
+        PFNGLGETQUERYOBJECTUI64VPROC get_query_objectui64v;
+    };
+
+    // Measures GPU time of the commands issued between begin() and end().
+    // Queries are kept in a ring and read back up to depth frames late, a
+    // result that is not available yet is never waited for: the frame is
+    // skipped instead. Query objects are not shared between contexts, so
+    // begin(), end() and collect() require the owning context to be current.
+    struct gpu_timer
+    {
+        static constexpr size_t depth = 4;
+
+        gpu_timer(sdl_window& win,
+                  sdl_glcontext& context,
+                  gl_timer_query_functions const& gl)
+            : win(win)
+            , context(context)
+            , gl(gl)
+            , next(0)
+            , running(false)
+            , skipped(0)
+        {
+            std::fill(std::begin(pending), std::end(pending), false);
+
+            make_current(win, context);
+            gl.gen_queries(depth, queries);
+        }
+
+        gpu_timer(gpu_timer const&) = delete;
+        gpu_timer& operator=(gpu_timer const&) = delete;
+
+        ~gpu_timer()
+        {
+            make_current(win, context);
+            gl.delete_queries(depth, queries);
+        }
+
+        void begin()
+        {
+            assert(!running);
+
+            if (pending[next])
+            {
+                ++skipped;
+                return;
+            }
+
+            gl.begin_query(GL_TIME_ELAPSED, queries[next]);
+            running = true;
+        }
+
+        void end()
+        {
+            if (!running)
+                return;
+
+            gl.end_query(GL_TIME_ELAPSED);
+            pending[next] = true;
+            next = (next + 1) % depth;
+            running = false;
+        }
+
+        // adds elapsed times (in milliseconds) of finished queries to s
+        void collect(sg::sample_series& s)
+        {
+            for (size_t i = 0; i != depth; ++i)
+            {
+                size_t slot = (next + i) % depth;
+                if (!pending[slot])
+                    continue;
+
+                GLint available = 0;
+                gl.get_query_objectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+
+                GLuint64 elapsed = 0;
+                gl.get_query_objectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+                s.add(elapsed * 1e-6);
+                pending[slot] = false;
+            }
+        }
+
+        size_t take_skipped()
+        {
+            size_t result = skipped;
+            skipped = 0;
+            return result;
+        }
+
+    private:
+        sdl_window& win;
+        sdl_glcontext& context;
+        gl_timer_query_functions const& gl;
+        GLuint queries[depth];
+        bool pending[depth];
+        size_t next;
+        bool running;
+        size_t skipped;
+    };
+
+    struct gl_readback_functions
+    {
+        gl_readback_functions()
+            : supported(false)
+            , gen_buffers(nullptr)
+            , delete_buffers(nullptr)
+            , bind_buffer(nullptr)
+            , buffer_data(nullptr)
+            , map_buffer(nullptr)
+            , unmap_buffer(nullptr)
+            , fence_sync(nullptr)
+            , client_wait_sync(nullptr)
+            , delete_sync(nullptr)
+        {}
+
+        // requires a current GL context
+        void load()
+        {
+            if (!SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object")
+             || !SDL_GL_ExtensionSupported("GL_ARB_sync"))
+                return;
+
+            gen_buffers = reinterpret_cast<PFNGLGENBUFFERSPROC>(SDL_GL_GetProcAddress("glGenBuffers"));
+            delete_buffers = reinterpret_cast<PFNGLDELETEBUFFERSPROC>(SDL_GL_GetProcAddress("glDeleteBuffers"));
+            bind_buffer = reinterpret_cast<PFNGLBINDBUFFERPROC>(SDL_GL_GetProcAddress("glBindBuffer"));
+            buffer_data = reinterpret_cast<PFNGLBUFFERDATAPROC>(SDL_GL_GetProcAddress("glBufferData"));
+            map_buffer = reinterpret_cast<PFNGLMAPBUFFERPROC>(SDL_GL_GetProcAddress("glMapBuffer"));
+            unmap_buffer = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(SDL_GL_GetProcAddress("glUnmapBuffer"));
+            fence_sync = reinterpret_cast<PFNGLFENCESYNCPROC>(SDL_GL_GetProcAddress("glFenceSync"));
+            client_wait_sync = reinterpret_cast<PFNGLCLIENTWAITSYNCPROC>(SDL_GL_GetProcAddress("glClientWaitSync"));
+            delete_sync = reinterpret_cast<PFNGLDELETESYNCPROC>(SDL_GL_GetProcAddress("glDeleteSync"));
+
+            supported = gen_buffers && delete_buffers && bind_buffer && buffer_data
+                     && map_buffer && unmap_buffer
+                     && fence_sync && client_wait_sync && delete_sync;
+        }
+
+        bool supported;
+        PFNGLGENBUFFERSPROC gen_buffers;
+        PFNGLDELETEBUFFERSPROC delete_buffers;
+        PFNGLBINDBUFFERPROC bind_buffer;
+        PFNGLBUFFERDATAPROC buffer_data;
+        PFNGLMAPBUFFERPROC map_buffer;
+        PFNGLUNMAPBUFFERPROC unmap_buffer;
+        PFNGLFENCESYNCPROC fence_sync;
+        PFNGLCLIENTWAITSYNCPROC client_wait_sync;
+        PFNGLDELETESYNCPROC delete_sync;
+    };
+
+    // Reads the render texture back into a ring of pixel buffer objects
+    // and hands frames to a capture_writer once their copy finished, up to
+    // depth frames late. Like gpu_timer it never waits for the GPU: a
+    // frame whose slot is still busy is dropped. Requires the owning
+    // context to be current.
+    struct texture_readback
+    {
+        static constexpr size_t depth = 3;
+
+        texture_readback(sdl_window& win,
+                         sdl_glcontext& context,
+                         gl_readback_functions const& gl,
+                         sg::capture_writer& writer)
+            : win(win)
+            , context(context)
+            , gl(gl)
+            , writer(writer)
+            , next(0)
+        {
+            make_current(win, context);
+            for (slot& s : slots)
+            {
+                gl.gen_buffers(1, &s.buffer);
+                s.size = 0;
+                s.fence = nullptr;
+            }
+        }
+
+        texture_readback(texture_readback const&) = delete;
+        texture_readback& operator=(texture_readback const&) = delete;
+
+        ~texture_readback()
+        {
+            make_current(win, context);
+            for (slot& s : slots)
+            {
+                if (s.fence)
+                    gl.delete_sync(s.fence);
+                gl.delete_buffers(1, &s.buffer);
+            }
+        }
+
+        // copies width x height of the bound texture, which is
+        // texture_width x texture_height
+        void read(GLsizei texture_width, GLsizei texture_height, GLsizei width, GLsizei height)
+        {
+            collect(false);
+
+            slot& s = slots[next];
+            if (s.fence)
+            {
+                writer.drop();
+                return;
+            }
+
+            size_t size = static_cast<size_t>(texture_width) * texture_height * 4;
+            gl.bind_buffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+            if (s.size != size)
+            {
+                gl.buffer_data(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+                s.size = size;
+            }
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+            gl.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            s.fence = gl.fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            s.texture_width = texture_width;
+            s.width = width;
+            s.height = height;
+            next = (next + 1) % depth;
+        }
+
+        // hands finished copies to the writer, all of them if wait
+        void collect(bool wait)
+        {
+            for (size_t i = 0; i != depth; ++i)
+            {
+                slot& s = slots[(next + i) % depth];
+                if (!s.fence)
+                    continue;
+
+                GLenum status = gl.client_wait_sync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                    wait ? GL_TIMEOUT_IGNORED : 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    break;
+
+                gl.delete_sync(s.fence);
+                s.fence = nullptr;
+
+                gl.bind_buffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+                void const* pixels = gl.map_buffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+                if (pixels)
+                    writer.submit(s.width, s.height, static_cast<uint8_t const*>(pixels), s.texture_width * 4);
+                else
+                    writer.drop();
+                gl.unmap_buffer(GL_PIXEL_PACK_BUFFER);
+                gl.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+        }
+
+    private:
+        struct slot
+        {
+            GLuint buffer;
+            size_t size;
+            GLsync fence; // while the copy is in flight
+            GLsizei texture_width;
+            GLsizei width;
+            GLsizei height;
+        };
+
+        sdl_window& win;
+        sdl_glcontext& context;
+        gl_readback_functions const& gl;
+        sg::capture_writer& writer;
+        slot slots[depth];
+        size_t next;
+    };
+
+    // Time from dequeuing a key press until the frame that consumed it
+    // is drawn, flushed by cairo and presented by SDL_GL_SwapWindow().
+    struct key_latency
+    {
+        sg::sample_series drawn;
+        sg::sample_series flushed;
+        sg::sample_series presented;
+    };
+
+    struct frame_report
+    {
+        typedef std::chrono::steady_clock clock;
+
+        frame_report(uint32_t start, uint32_t interval)
+            : period_start(start)
+            , frames(0)
+            , gpu_skipped(0)
+        {
+            // at most a frame per millisecond, so that reports do not
+            // allocate after the first one
+            frame_interval.reserve(interval);
+            cpu_draw.reserve(interval);
+            cpu_present.reserve(interval);
+            gpu_raster.reserve(interval);
+            gpu_blit.reserve(interval);
+        }
+
+        static double ms(clock::time_point from, clock::time_point to)
+        {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        }
+
+        void key_down(SDL_Keycode key, clock::time_point dequeued)
+        {
+            pending_keys.push_back(std::make_pair(key, dequeued));
+        }
+
+        void frame_done(clock::time_point drawn, clock::time_point flushed, clock::time_point presented)
+        {
+            for (std::pair<SDL_Keycode, clock::time_point> const& k : pending_keys)
+            {
+                key_latency& l = latency[k.first];
+                l.drawn.add(ms(k.second, drawn));
+                l.flushed.add(ms(k.second, flushed));
+                l.presented.add(ms(k.second, presented));
+            }
+            pending_keys.clear();
+        }
+
+        void print_latency(std::ostream& os, std::string const& model_name)
+        {
+            for (std::pair<SDL_Keycode const, key_latency>& k : latency)
+            {
+                key_latency& l = k.second;
+                if (l.presented.empty())
+                    continue;
+
+                os << "sg: input latency of " << model_name
+                   << ", key " << SDL_GetKeyName(k.first) << " (" << l.presented.size() << "), ms p50/p99: ";
+                print_percentiles(os, "drawn", l.drawn);
+                os << ", ";
+                print_percentiles(os, "flushed", l.flushed);
+                os << ", ";
+                print_percentiles(os, "presented", l.presented);
+                os << std::endl;
+
+                l.drawn.clear();
+                l.flushed.clear();
+                l.presented.clear();
+            }
+        }
+
+        void print(std::ostream& os, uint32_t now)
+        {
+            uint32_t period = now - period_start;
+
+            os << "sg: " << frames << " frames in " << period << " ms ("
+               << (period != 0 ? frames * 1000. / period : 0.) << " fps), ms p50/p99: ";
+            print_percentiles(os, "interval", frame_interval);
+            os << ", ";
+            print_percentiles(os, "cpu draw", cpu_draw);
+            os << ", ";
+            print_percentiles(os, "cpu present", cpu_present);
+            os << ", ";
+            print_percentiles(os, "gpu raster", gpu_raster);
+            os << ", ";
+            print_percentiles(os, "gpu blit", gpu_blit);
+            if (gpu_skipped != 0)
+                os << " (" << gpu_skipped << " gpu samples skipped)";
+            os << std::endl;
+
+            period_start = now;
+            frames = 0;
+            gpu_skipped = 0;
+            frame_interval.clear();
+            cpu_draw.clear();
+            cpu_present.clear();
+            gpu_raster.clear();
+            gpu_blit.clear();
+        }
+
+        uint32_t period_start;
+        size_t frames;
+        size_t gpu_skipped;
+        sg::sample_series frame_interval;
+        sg::sample_series cpu_draw;
+        sg::sample_series cpu_present;
+        sg::sample_series gpu_raster;
+        sg::sample_series gpu_blit;
+        std::vector<std::pair<SDL_Keycode, clock::time_point>> pending_keys;
+        std::map<SDL_Keycode, key_latency> latency;
+    };
+
+    // Share of time every job_system worker spent running jobs, published
+    // as context counters each frame and printed with the periodic report.
+    struct worker_utilization
+    {
+        typedef std::chrono::steady_clock clock;
+
+        worker_utilization(sg::job_system const& jobs, sg::context& ctx)
+            : jobs(jobs)
+            , frame_start(clock::now())
+            , report_start(frame_start)
+        {
+            for (size_t i = 0; i != jobs.worker_count(); ++i)
+            {
+                std::stringstream name;
+                name << "worker " << i << " busy %";
+                counters.push_back(&ctx.counter(name.str()));
+                frame_busy.push_back(jobs.busy_ns(i));
+                report_busy.push_back(frame_busy.back());
+            }
+        }
+
+        void frame()
+        {
+            clock::time_point now = clock::now();
+            double period_ns = std::chrono::duration<double, std::nano>(now - frame_start).count();
+            frame_start = now;
+
+            for (size_t i = 0; i != counters.size(); ++i)
+            {
+                uint64_t busy = jobs.busy_ns(i);
+                *counters[i] = period_ns > 0 ? static_cast<int64_t>((busy - frame_busy[i]) * 100. / period_ns) : 0;
+                frame_busy[i] = busy;
+            }
+        }
+
+        void print(std::ostream& os)
+        {
+            clock::time_point now = clock::now();
+            double period_ns = std::chrono::duration<double, std::nano>(now - report_start).count();
+            report_start = now;
+
+            if (counters.empty())
+                return;
+
+            os << "sg: " << counters.size() << " workers busy %:";
+            for (size_t i = 0; i != counters.size(); ++i)
+            {
+                uint64_t busy = jobs.busy_ns(i);
+                os << " " << (period_ns > 0 ? static_cast<int>((busy - report_busy[i]) * 100. / period_ns) : 0);
+                report_busy[i] = busy;
+            }
+            os << std::endl;
+        }
+
+        sg::job_system const& jobs;
+        clock::time_point frame_start;
+        clock::time_point report_start;
+        std::vector<int64_t*> counters;
+        std::vector<uint64_t> frame_busy;
+        std::vector<uint64_t> report_busy;
+    };
+
+    // Time spent in every phase of sg::run up to the first frame.
+    struct startup_report
+    {
+        typedef std::chrono::steady_clock clock;
+
+        startup_report()
+            : start(clock::now())
+            , last(start)
+        {}
+
+        static double ms(clock::time_point from, clock::time_point to)
+        {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        }
+
+        void phase(char const* name)
+        {
+            clock::time_point now = clock::now();
+            phases.emplace_back(name, ms(last, now));
+            last = now;
+        }
+
+        double total() const
+        {
+            return ms(start, last);
+        }
+
+        void print(std::ostream& os) const
+        {
+            os << "sg: first frame after " << total() << " ms:";
+            for (size_t i = 0; i != phases.size(); ++i)
+                os << (i == 0 ? " " : ", ") << phases[i].first << " " << phases[i].second;
+            os << std::endl;
+        }
+
+        clock::time_point start;
+        clock::time_point last;
+        std::vector<std::pair<char const*, double>> phases;
+    };
+
+    // the part of sg::run setup that runs beside SDL and GL initialization
+    struct background_init
+    {
+        std::unique_ptr<sg::job_system> jobs;
+        std::unique_ptr<sg::input_replayer> replayer;
+        std::unique_ptr<sg::input_recorder> recorder;
+        std::unique_ptr<sg::stats_publisher> publisher;
+    };
+
+    // GL side of a win_params::pixel_format
+    struct texture_format
+    {
+        GLint internal_format;
+        GLenum format; // of the (absent) data at allocation
+        GLenum type;
+        cairo_content_t content;
+    };
+
+    texture_format get_texture_format(cairo_format_t format)
+    {
+        switch (format)
+        {
+        case CAIRO_FORMAT_ARGB32:
+            return texture_format{GL_RGBA, GL_BGRA_EXT, GL_UNSIGNED_BYTE, CAIRO_CONTENT_COLOR_ALPHA};
+        case CAIRO_FORMAT_RGB24:
+            return texture_format{GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE, CAIRO_CONTENT_COLOR};
+        case CAIRO_FORMAT_RGB16_565:
+            return texture_format{GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, CAIRO_CONTENT_COLOR};
+        default:
+            {
+                std::stringstream ss;
+                ss << "unsupported pixel format " << format;
+                throw std::runtime_error(ss.str());
+            }
+        }
+    }
+
+    // Texture the model draws into, with room to spare: a smaller or
+    // slightly larger size reuses it and the blit shows the top left
+    // width x height of it, so that dragging the window border does not
+    // reallocate it every frame.
+    struct render_texture
+    {
+        render_texture(sdl_window& win,
+                       sdl_glcontext& context,
+                       texture_format const& format,
+                       GLsizei width, GLsizei height)
+            : win(win)
+            , context(context)
+            , format(format)
+            , capacity_width(0)
+            , capacity_height(0)
+            , max_size(0)
+        {
+            make_current(win, context);
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+            glGenTextures(1, &handle);
+            allocate(width, height);
+        }
+
+        render_texture(render_texture const&) = delete;
+        render_texture& operator=(render_texture const&) = delete;
+
+        ~render_texture()
+        {
+            make_current(win, context);
+            glDeleteTextures(1, &handle);
+        }
+
+        // requires context to be current
+        void reserve(GLsizei width, GLsizei height)
+        {
+            if (width <= capacity_width && height <= capacity_height)
+                return;
+
+            // half again as much, so that a growing window reallocates a
+            // few times rather than on every resize event
+            allocate(grow(capacity_width, width), grow(capacity_height, height));
+        }
+
+        GLuint get() const
+        {
+            return handle;
+        }
+
+        GLsizei width() const
+        {
+            return capacity_width;
+        }
+
+        GLsizei height() const
+        {
+            return capacity_height;
+        }
+
+        // texture coordinates of the right and bottom edge of a surface
+        // of width x height
+        GLfloat right(GLsizei width) const
+        {
+            return (GLfloat)width / capacity_width;
+        }
+
+        GLfloat bottom(GLsizei height) const
+        {
+            return (GLfloat)height / capacity_height;
+        }
+
+    private:
+        GLsizei grow(GLsizei capacity, GLsizei size) const
+        {
+            if (size <= capacity)
+                return capacity;
+
+            return std::max(size, std::min<GLsizei>(capacity + capacity / 2, max_size));
+        }
+
+        void allocate(GLsizei width, GLsizei height)
+        {
+            glBindTexture(GL_TEXTURE_2D, handle);
+            glTexImage2D(
+                GL_TEXTURE_2D,
+                0,
+                format.internal_format,
+                width,
+                height,
+                0,
+                format.format,
+                format.type,
+                nullptr
+            );
+            capacity_width = width;
+            capacity_height = height;
+        }
+
+    private:
+        sdl_window& win;
+        sdl_glcontext& context;
+        texture_format format;
+        GLuint handle;
+        GLsizei capacity_width;
+        GLsizei capacity_height;
+        GLint max_size;
+    };
+
+    // A cairo-gl surface is created for a texture of a fixed size, the
+    // surface is recreated even when the texture is kept.
+    void resize_surface(render_texture& texture,
+                        texture_format const& format,
                         int width, int height,
                         sdl_window& sdl_win,
                         sdl_glcontext& context,
-                        sdl_glcontext& cairo_context,
                         cairo_surface& surface,
                         cairo_device const& device)
     {
         surface.destroy();
 
         make_current(sdl_win, context);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RGBA,
-            width,
-            height,
-            0,
-            GL_BGRA_EXT,
-            GL_UNSIGNED_BYTE,
-            nullptr
-        );
+        texture.reserve(width, height);
 
         try
         {
             surface.create(device.get(),
-                           CAIRO_CONTENT_COLOR_ALPHA,
-                           texture,
+                           format.content,
+                           texture.get(),
                            width,
                            height);
         }
@@ -303,11 +977,19 @@ namespace
 
 using namespace sg;
 
-context::context(void* window, uint32_t tex_width, uint32_t tex_height)
+context::context(void* window, uint32_t tex_width, uint32_t tex_height, uint64_t seed,
+                 sg::job_system* jobs, sg::assets* assets,
+                 model_factory first_model, std::type_info const& first_type)
     : should_quit(false)
     , window(window)
     , tex_width(tex_width)
     , tex_height(tex_height)
+    , random_(seed)
+    , jobs_(jobs)
+    , assets_(assets)
+    , first_model(std::move(first_model))
+    , first_type(&first_type)
+    , next_type(nullptr)
 {}
 
 void context::quit()
@@ -317,6 +999,9 @@ void context::quit()
 
 void context::toggle_fullscreen()
 {
+    if (!window)
+        return;
+
     static_cast<sdl_window*>(window)->toggle_fullscreen();
 }
 
@@ -330,10 +1015,97 @@ uint32_t context::height() const
     return tex_height;
 }
 
+sg::random& context::random()
+{
+    return random_;
+}
+
+int64_t& context::counter(std::string const& name)
+{
+    for (std::pair<std::string, int64_t>& c : counters)
+        if (c.first == name)
+            return c.second;
+
+    counters.emplace_back(name, 0);
+    return counters.back().second;
+}
+
+sg::job_system& context::jobs()
+{
+    return *jobs_;
+}
+
+sg::timer_wheel& context::timers()
+{
+    return timers_;
+}
+
+sg::assets& context::assets()
+{
+    return *assets_;
+}
+
+void context::restart()
+{
+    next_model = first_model;
+    next_type = first_type;
+}
+
+std::unique_ptr<sg::model> context::create_model()
+{
+    return std::unique_ptr<sg::model>(first_model(*this, nullptr));
+}
+
+bool context::apply_restart(std::unique_ptr<sg::model>& model)
+{
+    if (!next_model)
+        return false;
+
+    model_factory create = std::move(next_model);
+    next_model = nullptr;
+
+    // scripts of the old model cancel their own timers when destroyed,
+    // callbacks it left behind must not outlive it
+    model.reset();
+    timers_.clear();
+    model.reset(create(*this, nullptr));
+    return true;
+}
+
+sg::model* context::create_model(void* at)
+{
+    return first_model(*this, at);
+}
+
+bool context::apply_restart(sg::model*& model, void* at)
+{
+    if (!next_model)
+        return false;
+
+    if (*next_type != *first_type)
+    {
+        std::stringstream ss;
+        ss << "sg::run<" << first_type->name() << "> cannot restart with a model of type " << next_type->name();
+        throw std::runtime_error(ss.str());
+    }
+
+    model_factory create = std::move(next_model);
+    next_model = nullptr;
+
+    model->~model();
+    model = nullptr;
+    timers_.clear();
+    model = create(*this, at);
+    return true;
+}
+
 model::model(context& ctx)
     : ctx_(&ctx)
 {}
 
+model::~model()
+{}
+
 context& model::ctx()
 {
     return *ctx_;
@@ -361,11 +1133,59 @@ win_params::win_params()
     , height_(480)
     , resizing_policy_(resizing_policy_t::preserve_aspect_ratio)
     , title_("Simple Game Window")
+    , pixel_format_(CAIRO_FORMAT_ARGB32)
     , min_frame_interval_(0)
-    , model_creation_func_([] (sg::context& ctx) {
-        return std::make_unique<sg::model>(ctx);
-    })
-{}
+    , stats_interval_(0)
+    , latency_overlay_(false)
+    , alloc_audit_(false)
+    , alloc_audit_warmup_(0)
+    , workers_(job_system::default_worker_count())
+    , pin_workers_(false)
+    , asset_memory_(256)
+    , asset_budget_(2000)
+    , seed_((uint64_t)std::random_device()() << 32 | std::random_device()())
+    , model_creation_func_(&create_model<sg::model>)
+    , model_type_(&typeid(sg::model))
+{
+    if (char const* format = std::getenv("SG_PIXEL_FORMAT"))
+    {
+        if (std::strcmp(format, "argb32") == 0)
+            pixel_format_ = CAIRO_FORMAT_ARGB32;
+        else if (std::strcmp(format, "rgb24") == 0)
+            pixel_format_ = CAIRO_FORMAT_RGB24;
+        else if (std::strcmp(format, "rgb16_565") == 0)
+            pixel_format_ = CAIRO_FORMAT_RGB16_565;
+        else
+            pixel_format_ = CAIRO_FORMAT_INVALID;
+    }
+    if (char const* interval = std::getenv("SG_STATS_INTERVAL"))
+        stats_interval_ = std::strtoul(interval, nullptr, 10);
+    if (char const* overlay = std::getenv("SG_LATENCY_OVERLAY"))
+        latency_overlay_ = std::strcmp(overlay, "0") != 0;
+    if (char const* name = std::getenv("SG_STATS_SHM"))
+        stats_shm_ = name;
+    if (char const* warmup = std::getenv("SG_ALLOC_AUDIT"))
+    {
+        alloc_audit_ = true;
+        alloc_audit_warmup_ = std::strtoul(warmup, nullptr, 10);
+    }
+    if (char const* workers = std::getenv("SG_WORKERS"))
+        workers_ = std::strtoul(workers, nullptr, 10);
+    if (char const* pin = std::getenv("SG_PIN_WORKERS"))
+        pin_workers_ = std::strcmp(pin, "0") != 0;
+    if (char const* memory = std::getenv("SG_ASSET_MEMORY"))
+        asset_memory_ = std::strtoul(memory, nullptr, 10);
+    if (char const* budget = std::getenv("SG_ASSET_BUDGET"))
+        asset_budget_ = std::strtoul(budget, nullptr, 10);
+    if (char const* seed = std::getenv("SG_SEED"))
+        seed_ = std::strtoull(seed, nullptr, 10);
+    if (char const* path = std::getenv("SG_RECORD"))
+        record_path_ = path;
+    if (char const* path = std::getenv("SG_REPLAY"))
+        replay_path_ = path;
+    if (char const* path = std::getenv("SG_CAPTURE"))
+        capture_path_ = path;
+}
 
 win_params& win_params::width(uint32_t value)
 {
@@ -391,204 +1211,711 @@ win_params& win_params::title(std::string title)
     return *this;
 }
 
+win_params& win_params::pixel_format(cairo_format_t value)
+{
+    pixel_format_ = value;
+    return *this;
+}
+
 win_params& win_params::min_frame_interval(uint32_t value)
 {
     min_frame_interval_ = value;
     return *this;
 }
 
-void sg::run(win_params const& p)
+win_params& win_params::stats_interval(uint32_t value)
+{
+    stats_interval_ = value;
+    return *this;
+}
+
+win_params& win_params::latency_overlay(bool value)
 {
-    sdl_initializer sdl_init(SDL_INIT_VIDEO);
-    sdl_window sdl_win(p.title_.c_str(), p.width_, p.height_,
+    latency_overlay_ = value;
+    return *this;
+}
+
+win_params& win_params::stats_shm(std::string name)
+{
+    stats_shm_ = std::move(name);
+    return *this;
+}
+
+win_params& win_params::alloc_audit(uint32_t warmup_frames)
+{
+    alloc_audit_ = true;
+    alloc_audit_warmup_ = warmup_frames;
+    return *this;
+}
+
+win_params& win_params::workers(uint32_t value)
+{
+    workers_ = value;
+    return *this;
+}
+
+win_params& win_params::pin_workers(bool value)
+{
+    pin_workers_ = value;
+    return *this;
+}
+
+win_params& win_params::asset_memory(uint32_t value)
+{
+    asset_memory_ = value;
+    return *this;
+}
+
+win_params& win_params::asset_budget(uint32_t value)
+{
+    asset_budget_ = value;
+    return *this;
+}
+
+win_params& win_params::capture(std::string path)
+{
+    capture_path_ = std::move(path);
+    return *this;
+}
+
+win_params& win_params::seed(uint64_t value)
+{
+    seed_ = value;
+    return *this;
+}
+
+win_params& win_params::record(std::string path)
+{
+    record_path_ = std::move(path);
+    return *this;
+}
+
+win_params& win_params::replay(std::string path)
+{
+    replay_path_ = std::move(path);
+    return *this;
+}
+
+struct window_loop::impl
+{
+    impl(win_params const& p, context::model_factory first_model, std::type_info const& first_type);
+
+    win_params const& p;
+    startup_report startup;
+    texture_format format;
+
+    // threads, files and shared memory do not depend on the window, they
+    // are set up while SDL and GL are
+    std::future<background_init> background;
+
+    std::unique_ptr<sdl_initializer> sdl_init;
+    std::unique_ptr<sdl_window> sdl_win;
+    std::unique_ptr<sdl_glcontext> context;
+    std::unique_ptr<sdl_glcontext> cairo_context;
+    std::unique_ptr<sdl_makecurrent_null> makecurrent_null;
+    std::unique_ptr<cairo_device> device;
+    std::unique_ptr<render_texture> texture;
+    std::unique_ptr<cairo_surface> surface;
+
+    gl_timer_query_functions timer_queries;
+    std::unique_ptr<gpu_timer> raster_timer;
+    std::unique_ptr<gpu_timer> blit_timer;
+
+    gl_readback_functions readback_functions;
+    std::unique_ptr<capture_writer> capture;
+    std::unique_ptr<texture_readback> readback;
+
+    uint32_t last_frame_start;
+    std::unique_ptr<frame_report> report;
+
+    background_init side;
+    std::unique_ptr<sg::assets> loader;
+    std::unique_ptr<sg::context> ctx;
+    std::unique_ptr<worker_utilization> utilization;
+    int64_t* assets_pending;
+    int64_t* asset_memory;
+    int64_t* first_frame_us;
+    int64_t* capture_dropped;
+
+    frame_arena arena;
+    uint64_t frame_index;
+    bool resize_pending;
+    int window_width;
+    int window_height;
+
+    // the frame under way
+    startup_report::clock::time_point restart_start;
+    bool frame_started;
+    uint32_t this_frame_start;
+    uint32_t frame_time;
+    // replaying and the recorded frame not read yet
+    bool awaiting_frame;
+    // the event input() read past the keys of the frame shown, replayed()
+    // returns it first
+    bool replay_held;
+    input_event replay_next;
+    frame_report::clock::time_point draw_start;
+    bool frame_due;
+};
+
+window_loop::impl::impl(win_params const& p, context::model_factory first_model, std::type_info const& first_type)
+    : p(p)
+    , format(get_texture_format(p.pixel_format_))
+    , frame_index(0)
+    , resize_pending(false)
+    , window_width(0)
+    , window_height(0)
+    , frame_started(false)
+    , this_frame_start(0)
+    , frame_time(0)
+    , awaiting_frame(false)
+    , replay_held(false)
+    , frame_due(false)
+{
+    background = std::async(std::launch::async, [&p]
+    {
+        background_init result;
+        result.jobs = std::make_unique<job_system>(p.workers_, p.pin_workers_);
+
+        uint64_t seed = p.seed_;
+        if (!p.replay_path_.empty())
+        {
+            result.replayer = std::make_unique<input_replayer>(p.replay_path_);
+            seed = result.replayer->seed();
+        }
+        if (!p.record_path_.empty())
+            result.recorder = std::make_unique<input_recorder>(p.record_path_, seed);
+
+        if (!p.stats_shm_.empty())
+            result.publisher = std::make_unique<stats_publisher>(p.stats_shm_);
+
+        return result;
+    });
+
+    sdl_init = std::make_unique<sdl_initializer>(SDL_INIT_VIDEO);
+    startup.phase("sdl");
+    sdl_win = std::make_unique<sdl_window>(p.title_.c_str(), p.width_, p.height_,
         SDL_WINDOW_OPENGL
       | (p.resizing_policy_ != win_params::resizing_policy_t::no_resize ? SDL_WINDOW_RESIZABLE : 0));
+    startup.phase("window");
 
     SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
 
-    sdl_glcontext context(sdl_win.get());
-    sdl_glcontext cairo_context(sdl_win.get());
-    sdl_makecurrent_null makecurrent_null(sdl_win.get());
+    context = std::make_unique<sdl_glcontext>(sdl_win->get());
+    cairo_context = std::make_unique<sdl_glcontext>(sdl_win->get());
+    makecurrent_null = std::make_unique<sdl_makecurrent_null>(sdl_win->get());
+    startup.phase("gl contexts");
 
-    SDL_SysWMinfo wm_info = sdl_win.get_wm_info();
+    SDL_SysWMinfo wm_info = sdl_win->get_wm_info();
 
-    cairo_device device(wm_info.info.x11.display,
-                        reinterpret_cast<GLXContext>(cairo_context.get()));
+    device = std::make_unique<cairo_device>(wm_info.info.x11.display,
+                                            reinterpret_cast<GLXContext>(cairo_context->get()));
+    startup.phase("cairo device");
 
-    make_current(sdl_win, context);
+    make_current(*sdl_win, *context);
     glEnable(GL_TEXTURE_2D);
     glViewport(0.0, 0.0, p.width_, p.height_);
     glClearColor(0., 0., 0., 1.0);
+    // the texture replaces the framebuffer, also where it has alpha
+    glDisable(GL_BLEND);
+
+    texture = std::make_unique<render_texture>(*sdl_win, *context, format, p.width_, p.height_);
+
+    surface = std::make_unique<cairo_surface>(*sdl_win, *cairo_context,
+                                              device->get(),
+                                              format.content,
+                                              texture->get(),
+                                              p.width_,
+                                              p.height_);
+    startup.phase("surface");
+
+    if (p.stats_interval_ != 0)
+    {
+        make_current(*sdl_win, *context);
+        timer_queries.load();
+        if (timer_queries.supported)
+        {
+            raster_timer = std::make_unique<gpu_timer>(*sdl_win, *cairo_context, timer_queries);
+            blit_timer = std::make_unique<gpu_timer>(*sdl_win, *context, timer_queries);
+        }
+        else
+            std::clog << "sg: GL_ARB_timer_query is not supported, GPU timings are disabled" << std::endl;
+        startup.phase("gpu timers");
+    }
 
-    GLuint texture;
-
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA,
-        p.width_,
-        p.height_,
-        0,
-        GL_BGRA_EXT,
-        GL_UNSIGNED_BYTE,
-        nullptr
-    );
-
-    cairo_surface surface(sdl_win, cairo_context,
-                          device.get(),
-                          CAIRO_CONTENT_COLOR_ALPHA,
-                          texture,
-                          p.width_,
-                          p.height_);
+    if (!p.capture_path_.empty())
+    {
+        make_current(*sdl_win, *context);
+        readback_functions.load();
+        if (readback_functions.supported)
+        {
+            capture = std::make_unique<capture_writer>(p.capture_path_,
+                p.min_frame_interval_ != 0 ? 1000 / p.min_frame_interval_ : 60);
+            readback = std::make_unique<texture_readback>(*sdl_win, *context, readback_functions, *capture);
+        }
+        else
+            std::clog << "sg: GL_ARB_pixel_buffer_object or GL_ARB_sync is not supported, capture is disabled" << std::endl;
+        startup.phase("capture");
+    }
 
     uint32_t start = SDL_GetTicks();
-    uint32_t last_frame_start = start;
+    last_frame_start = start;
+    report = std::make_unique<frame_report>(start, p.stats_interval_);
+
+    side = background.get();
+    startup.phase("background wait");
+    uint64_t seed = side.replayer ? side.replayer->seed() : p.seed_;
+
+    // two loader threads, decoding is I/O bound as much as CPU bound
+    loader = std::make_unique<sg::assets>(device->get(), (size_t)p.asset_memory_ << 20, 2);
+    ctx.reset(new sg::context(sdl_win.get(), p.width_, p.height_, seed, side.jobs.get(), loader.get(),
+                              std::move(first_model), first_type));
+    utilization = std::make_unique<worker_utilization>(*side.jobs, *ctx);
+    assets_pending = &ctx->counter("assets pending");
+    asset_memory = &ctx->counter("asset memory KB");
+    first_frame_us = &ctx->counter("time to first frame us");
+    capture_dropped = &ctx->counter("capture dropped");
+    make_current(*sdl_win, *cairo_context);
+}
 
-    SDL_Event event;
+window_loop::window_loop(win_params const& p, context::model_factory first_model, std::type_info const& first_type)
+    : impl_(std::make_unique<impl>(p, std::move(first_model), first_type))
+{}
+
+window_loop::~window_loop()
+{}
+
+sg::context& window_loop::ctx()
+{
+    return *impl_->ctx;
+}
+
+void window_loop::model_created()
+{
+    impl_->startup.phase("model");
+}
+
+bool window_loop::begin_frame()
+{
+    impl& l = *impl_;
+    if (l.ctx->should_quit)
+        return false;
+
+    if (l.p.alloc_audit_ && l.frame_index == l.p.alloc_audit_warmup_)
+        start_alloc_audit();
+    ++l.frame_index;
+    l.frame_started = false;
+    l.frame_due = false;
+
+    l.restart_start = startup_report::clock::now();
+    make_current(*l.sdl_win, *l.cairo_context);
+    return true;
+}
+
+void window_loop::restarted()
+{
+    impl& l = *impl_;
+    if (l.p.stats_interval_ != 0)
+        std::clog << "sg: model restarted in "
+                  << startup_report::ms(l.restart_start, startup_report::clock::now()) << " ms" << std::endl;
+}
+
+bool window_loop::resize(sg::model::resize_params& rp)
+{
+    impl& l = *impl_;
+    win_params const& p = l.p;
+    sg::context& ctx = *l.ctx;
+
+    if (!l.resize_pending)
+        return false;
+    l.resize_pending = false;
 
-    sg::context ctx(&sdl_win, p.width_, p.height_);
-    make_current(sdl_win, cairo_context);
-    std::unique_ptr<sg::model> model = p.model_creation_func_(ctx);
-    while (!ctx.should_quit)
+    rp.old_width = ctx.tex_width;
+    rp.old_height = ctx.tex_height;
+
+    switch (p.resizing_policy_)
     {
-        uint32_t this_frame_start = SDL_GetTicks();
-        make_current(sdl_win, cairo_context);
+    case win_params::resizing_policy_t::no_resize:
+        assert(false);
+        break;
+    case win_params::resizing_policy_t::centered:
+        make_current(*l.sdl_win, *l.context);
+        glViewport(l.window_width / 2 - p.width_ / 2,
+                   l.window_height / 2 - p.height_ / 2,
+                   p.width_,
+                   p.height_);
+        break;
+    case win_params::resizing_policy_t::preserve_aspect_ratio:
         {
-            sg::model::draw_params dp = {
-                this_frame_start - last_frame_start,
-                surface.get()
-            };
-            model->draw(dp);
+            if ((uint64_t)l.window_width * p.height_ < (uint64_t)l.window_height * p.width_)
+            {
+                ctx.tex_width = l.window_width;
+                ctx.tex_height = (uint64_t)l.window_width * p.height_ / p.width_;
+            }
+            else
+            {
+                ctx.tex_width = (uint64_t)l.window_height * p.width_ / p.height_;
+                ctx.tex_height = l.window_height;
+            }
+            make_current(*l.sdl_win, *l.context);
+            glViewport(l.window_width / 2 - ctx.tex_width / 2,
+                       l.window_height / 2 - ctx.tex_height / 2,
+                       ctx.tex_width,
+                       ctx.tex_height);
+            if (ctx.tex_width != rp.old_width || ctx.tex_height != rp.old_height)
+                resize_surface(*l.texture, l.format, ctx.tex_width, ctx.tex_height, *l.sdl_win, *l.context, *l.surface, *l.device);
+            break;
         }
+    case win_params::resizing_policy_t::scaled:
+        ctx.tex_width = l.window_width;
+        ctx.tex_height = l.window_height;
 
-        surface.swap_buffers();
+        make_current(*l.sdl_win, *l.context);
+        glViewport(0, 0, ctx.tex_width, ctx.tex_height);
 
-        make_current(sdl_win, context);
+        if (ctx.tex_width != rp.old_width || ctx.tex_height != rp.old_height)
+            resize_surface(*l.texture, l.format, ctx.tex_width, ctx.tex_height, *l.sdl_win, *l.context, *l.surface, *l.device);
+        break;
 
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        gluOrtho2D(0.0, 1.0, 0.0, 1.0);
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glBegin(GL_QUADS);
+    default:
+        assert(false);
+        break;
+    }
 
-        glTexCoord2i(0., 1.);
-        glVertex2i(0., 0.);
+    rp.width = ctx.tex_width;
+    rp.height = ctx.tex_height;
 
-        glTexCoord2i(0., 0.);
-        glVertex2i(0., 1.);
+    if (l.side.recorder)
+    {
+        input_event e;
+        e.type = input_event::type_t::resize;
+        e.width = ctx.tex_width;
+        e.height = ctx.tex_height;
+        l.side.recorder->write(e);
+    }
+    return true;
+}
 
-        glTexCoord2i(1., 0.);
-        glVertex2i(1., 1.);
+bool window_loop::replayed(input_event& e)
+{
+    impl& l = *impl_;
+    if (!l.frame_started)
+    {
+        l.frame_started = true;
+        l.this_frame_start = SDL_GetTicks();
+        l.frame_time = l.this_frame_start - l.last_frame_start;
+        l.awaiting_frame = l.side.replayer != nullptr;
+    }
+
+    if (!l.awaiting_frame)
+        return false;
+    if (l.replay_held)
+    {
+        e = l.replay_next;
+        l.replay_held = false;
+    }
+    else if (!l.side.replayer->read(e))
+        return false;
+    if (e.type != input_event::type_t::frame)
+        return true;
+
+    l.frame_time = e.frame_time;
+    l.awaiting_frame = false;
+    return false;
+}
 
-        glTexCoord2i(1., 1.);
-        glVertex2i(1., 0.);
+bool window_loop::replayed_resize(input_event const& e, sg::model::resize_params& rp)
+{
+    impl& l = *impl_;
+    sg::context& ctx = *l.ctx;
+
+    rp.width = e.width;
+    rp.height = e.height;
+    rp.old_width = ctx.tex_width;
+    rp.old_height = ctx.tex_height;
+
+    // the window follows the recorded surface, whatever the policy made
+    // of the recorded window size
+    if (e.width != ctx.tex_width || e.height != ctx.tex_height)
+    {
+        ctx.tex_width = e.width;
+        ctx.tex_height = e.height;
+        l.window_width = e.width;
+        l.window_height = e.height;
+        l.sdl_win->set_size(e.width, e.height);
+
+        make_current(*l.sdl_win, *l.context);
+        glViewport(0, 0, ctx.tex_width, ctx.tex_height);
+        resize_surface(*l.texture, l.format, ctx.tex_width, ctx.tex_height, *l.sdl_win, *l.context, *l.surface, *l.device);
+    }
+    return true;
+}
+
+bool window_loop::begin_draw(sg::model::draw_params& dp)
+{
+    impl& l = *impl_;
+    if (l.awaiting_frame)
+        return false;
 
+    if (l.side.recorder)
+    {
+        input_event e;
+        e.type = input_event::type_t::frame;
+        e.frame_time = l.frame_time;
+        l.side.recorder->write(e);
+    }
+
+    l.draw_start = frame_report::clock::now();
+    make_current(*l.sdl_win, *l.cairo_context);
+    l.ctx->timers_.advance(timer_wheel::duration(l.frame_time));
+    l.loader->update(sg::assets::duration(l.p.asset_budget_));
+    *l.assets_pending = l.loader->pending();
+    *l.asset_memory = l.loader->memory_used() >> 10;
+    if (l.raster_timer)
+    {
+        l.raster_timer->collect(l.report->gpu_raster);
+        l.raster_timer->begin();
+    }
+
+    dp.frame_time = l.frame_time;
+    dp.surface = l.surface->get();
+    dp.arena = &l.arena;
+    return true;
+}
+
+void window_loop::end_draw()
+{
+    impl& l = *impl_;
+    win_params const& p = l.p;
+    sg::context& ctx = *l.ctx;
+    frame_report& report = *l.report;
+
+    l.arena.reset();
+
+    frame_report::clock::time_point drawn = frame_report::clock::now();
+    l.surface->swap_buffers();
+    if (l.raster_timer)
+        l.raster_timer->end();
+
+    frame_report::clock::time_point present_start = frame_report::clock::now();
+    make_current(*l.sdl_win, *l.context);
+    if (l.blit_timer)
+    {
+        l.blit_timer->collect(report.gpu_blit);
+        l.blit_timer->begin();
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0.0, 1.0, 0.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, l.texture->get());
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    GLfloat right = l.texture->right(ctx.tex_width);
+    GLfloat bottom = l.texture->bottom(ctx.tex_height);
+    glBegin(GL_QUADS);
+
+    glTexCoord2f(0., bottom);
+    glVertex2i(0., 0.);
+
+    glTexCoord2f(0., 0.);
+    glVertex2i(0., 1.);
+
+    glTexCoord2f(right, 0.);
+    glVertex2i(1., 1.);
+
+    glTexCoord2f(right, bottom);
+    glVertex2i(1., 0.);
+
+    glEnd();
+
+    if (p.latency_overlay_ && !report.pending_keys.empty())
+    {
+        // a marker in the top left corner on the frame that consumed
+        // a key press, for end to end validation with a camera
+        glDisable(GL_TEXTURE_2D);
+        glBegin(GL_QUADS);
+        glVertex2f(0.f, 1.f);
+        glVertex2f(0.06f, 1.f);
+        glVertex2f(0.06f, 0.94f);
+        glVertex2f(0.f, 0.94f);
         glEnd();
+        glEnable(GL_TEXTURE_2D);
+    }
 
-        SDL_GL_SwapWindow(sdl_win.get());
+    if (l.blit_timer)
+        l.blit_timer->end();
 
-        last_frame_start = this_frame_start;
+    if (l.readback)
+    {
+        l.readback->read(l.texture->width(), l.texture->height(), ctx.tex_width, ctx.tex_height);
+        *l.capture_dropped = l.capture->dropped();
+    }
+
+    SDL_GL_SwapWindow(l.sdl_win->get());
+    // presented when the swap returns, before the reports below
+    frame_report::clock::time_point present_end = frame_report::clock::now();
 
-        while (!ctx.should_quit)
+    if (l.frame_index == 1)
+    {
+        l.startup.phase("first frame");
+        *l.first_frame_us = static_cast<int64_t>(l.startup.total() * 1000.);
+        if (p.stats_interval_ != 0)
+            l.startup.print(std::clog);
+    }
+
+    l.utilization->frame();
+    if (l.side.publisher)
+        l.side.publisher->publish(l.frame_time, ctx.tex_width, ctx.tex_height, ctx.counters);
+
+    if (p.stats_interval_ != 0)
+    {
+        report.frame_done(drawn, present_start, present_end);
+        ++report.frames;
+        report.frame_interval.add(l.frame_time);
+        report.cpu_draw.add(frame_report::ms(l.draw_start, present_start));
+        report.cpu_present.add(frame_report::ms(present_start, present_end));
+
+        if (l.this_frame_start - report.period_start >= p.stats_interval_)
         {
-            uint32_t current_time = SDL_GetTicks();
-            uint32_t timeout = p.min_frame_interval_ - std::min(current_time - last_frame_start, p.min_frame_interval_);
+            if (l.raster_timer)
+                report.gpu_skipped += l.raster_timer->take_skipped() + l.blit_timer->take_skipped();
+            report.print(std::clog, l.this_frame_start);
+            report.print_latency(std::clog, p.title_);
+            l.utilization->print(std::clog);
+        }
+    }
+    else
+        report.pending_keys.clear();
 
-            if (!SDL_WaitEventTimeout(&event, std::max(timeout, 1u)))
-                break;
+    l.last_frame_start = l.this_frame_start;
+}
+
+bool window_loop::input(input_event& e)
+{
+    impl& l = *impl_;
+    win_params const& p = l.p;
+    sg::context& ctx = *l.ctx;
+
+    // keys are recorded after the frame they came in during, they reach
+    // the model before the next one starts, as they did live: before a
+    // restart() they asked for
+    if (l.side.replayer && !l.replay_held && l.side.replayer->read(l.replay_next))
+    {
+        if (l.replay_next.type == input_event::type_t::key_down
+         || l.replay_next.type == input_event::type_t::key_up)
+        {
+            e = l.replay_next;
+            return true;
+        }
+        l.replay_held = true;
+    }
 
-            switch (event.type)
+    SDL_Event event;
+    while (!l.frame_due && !ctx.should_quit)
+    {
+        uint32_t current_time = SDL_GetTicks();
+        uint32_t timeout = p.min_frame_interval_ - std::min(current_time - l.last_frame_start, p.min_frame_interval_);
+
+        // a frame is due when the next timer is, model time stands at
+        // last_frame_start
+        uint64_t next_timer = ctx.timers_.time_to_next().count();
+        uint32_t since_frame = current_time - l.last_frame_start;
+        if (next_timer <= since_frame)
+            timeout = 0;
+        else if (next_timer - since_frame < timeout)
+            timeout = next_timer - since_frame;
+
+        if (!SDL_WaitEventTimeout(&event, std::max(timeout, 1u)))
+            break;
+        l.frame_due = timeout == 0;
+
+        switch (event.type)
+        {
+        case SDL_QUIT:
+            ctx.quit();
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
             {
-            case SDL_QUIT:
-                ctx.quit();
-                break;
-            case SDL_KEYDOWN:
-                {
-                    model::key_down_params kdp;
-                    kdp.key = event.key.keysym.sym;
-                    kdp.mod = event.key.keysym.mod;
-                    model->key_down(kdp);
-                    break;
-                }
-            case SDL_KEYUP:
-                {
-                    model::key_up_params kup;
-                    kup.key = event.key.keysym.sym;
-                    kup.mod = event.key.keysym.mod;
-                    model->key_up(kup);
-                    break;
-                }
-            case SDL_WINDOWEVENT:
+                e.type = event.type == SDL_KEYDOWN ? input_event::type_t::key_down
+                                                   : input_event::type_t::key_up;
+                e.key = event.key.keysym.sym;
+                e.mod = event.key.keysym.mod;
+
+                if (l.side.replayer)
                 {
-                    if (event.window.event == SDL_WINDOWEVENT_RESIZED)
-                    {
-                        switch (p.resizing_policy_)
-                        {
-                        case win_params::resizing_policy_t::no_resize:
-                            assert(false);
-                            break;
-                        case win_params::resizing_policy_t::centered:
-                            make_current(sdl_win, context);
-                            glViewport(event.window.data1 / 2 - p.width_ / 2,
-                                       event.window.data2 / 2 - p.height_ / 2,
-                                       p.width_,
-                                       p.height_);
-                            break;
-                        case win_params::resizing_policy_t::preserve_aspect_ratio:
-                            {
-                                if ((uint64_t)event.window.data1 * p.height_ < (uint64_t)event.window.data2 * p.width_)
-                                {
-                                    ctx.tex_width = event.window.data1;
-                                    ctx.tex_height = (uint64_t)event.window.data1 * p.height_ / p.width_;
-                                }
-                                else
-                                {
-                                    ctx.tex_width = (uint64_t)event.window.data2 * p.width_ / p.height_;
-                                    ctx.tex_height = event.window.data2;
-                                }
-                                make_current(sdl_win, context);
-                                glViewport(event.window.data1 / 2 - ctx.tex_width / 2,
-                                           event.window.data2 / 2 - ctx.tex_height / 2,
-                                           ctx.tex_width,
-                                           ctx.tex_height);
-                                resize_surface(texture, ctx.tex_width, ctx.tex_height, sdl_win, context, cairo_context, surface, device);
-                                break;
-                            }
-                        case win_params::resizing_policy_t::scaled:
-                            ctx.tex_width = event.window.data1;
-                            ctx.tex_height = event.window.data2;
-
-                            make_current(sdl_win, context);
-                            glViewport(0, 0, ctx.tex_width, ctx.tex_height);
-
-                            resize_surface(texture, ctx.tex_width, ctx.tex_height, sdl_win, context, cairo_context,surface, device);
-                            break;
-
-                        default:
-                            assert(false);
-                            break;
-                        }
-
-                        model->resize(sg::model::resize_params());
-                    }
+                    // live input is not fed to a replayed session
+                    if (e.type == input_event::type_t::key_down && e.key == SDLK_ESCAPE)
+                        ctx.quit();
                     break;
                 }
-            default:
-                break;
-            }
 
-            if (timeout == 0)
-                break;
+                if (e.type == input_event::type_t::key_down
+                 && (p.stats_interval_ != 0 || p.latency_overlay_))
+                    l.report->key_down(e.key, frame_report::clock::now());
+
+                if (l.side.recorder)
+                    l.side.recorder->write(e);
+                return true;
+            }
+        case SDL_WINDOWEVENT:
+            // applied before the next frame, a drag produces many; a
+            // replay takes its sizes from the recording
+            if (event.window.event == SDL_WINDOWEVENT_RESIZED && !l.side.replayer)
+            {
+                l.resize_pending = true;
+                l.window_width = event.window.data1;
+                l.window_height = event.window.data2;
+            }
+            break;
+        default:
+            break;
         }
     }
+
+    return false;
+}
+
+void window_loop::finish()
+{
+    impl& l = *impl_;
+    if (l.readback)
+    {
+        make_current(*l.sdl_win, *l.context);
+        l.readback->collect(true);
+        l.capture->close();
+        std::clog << "sg: captured " << l.capture->written() << " frames to " << l.p.capture_path_
+                  << ", " << l.capture->dropped() << " dropped" << std::endl;
+    }
+
+    if (l.p.alloc_audit_)
+    {
+        stop_alloc_audit();
+        if (alloc_audit_linked())
+            std::clog << "sg: " << audited_allocations() << " heap allocations after "
+                      << l.p.alloc_audit_warmup_ << " warm-up frames" << std::endl;
+        else
+            std::clog << "sg: no heap allocation audit in this build, configure with -DSG_ALLOC_AUDIT=ON" << std::endl;
+    }
+}
+
+void sg::run(win_params const& p)
+{
+    window_loop loop(p, p.model_creation_func_, *p.model_type_);
+    std::unique_ptr<sg::model> model = loop.ctx().create_model();
+    sg::model* current = model.get();
+    loop.frames(current, [&]
+    {
+        if (!loop.ctx().apply_restart(model))
+            return false;
+        current = model.get();
+        return true;
+    });
 }
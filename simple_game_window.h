@@ -1,21 +1,39 @@
 #pragma once
 
+#include <concepts>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 
 #include <cairo.h>
 #include <SDL2/SDL_keycode.h>
 
+#include "assets.h"
+#include "frame_arena.h"
+#include "input_log.h"
+#include "job_system.h"
+#include "random.h"
+#include "timer_wheel.h"
+
 namespace sg
 {
     struct context;
+    struct headless;
     struct model;
     struct win_params;
+    struct window_loop;
 
     void run(win_params const&);
 
+    template <typename M, typename... Args>
+    void run(win_params const&, Args&&... args);
+
     struct context
     {
         void quit();
@@ -23,20 +41,96 @@ namespace sg
         uint32_t width() const;
         uint32_t height() const;
 
+        // the only source of randomness a model should use, seeded from
+        // win_params so that sessions can be replayed
+        sg::random& random();
+
+        // Registers a named value published with the frame statistics, e.g.
+        // an object count. The reference stays valid for the lifetime of the
+        // context, registering the same name again returns the same value.
+        int64_t& counter(std::string const& name);
+
+        // thread pool for the simulation; drawing with cairo stays on the
+        // thread that calls the model
+        sg::job_system& jobs();
+
+        // timers in model time, advanced by the frame time before every
+        // frame; the earliest deadline also wakes up the loop
+        sg::timer_wheel& timers();
+
+        // images decoded in the background and uploaded a few per frame,
+        // load them ahead, e.g. in the constructor, and draw them once ready
+        sg::assets& assets();
+
+        // Replaces the model by a new one before the next frame, keeping
+        // the window, GL contexts and surfaces: the current model is
+        // destroyed first and its timers are cancelled. restart() creates
+        // the model win_params was given, restart<M>(args...) an
+        // M(ctx, args...). Under run<M>() the next model is an M again,
+        // created in place of the current one.
+        void restart();
+
+        template <typename M, typename... Args>
+        void restart(Args&&... args)
+        {
+            next_model = [... args = std::forward<Args>(args)](sg::context& ctx, void* at) -> sg::model*
+            {
+                return at ? new (at) M(ctx, args...) : new M(ctx, args...);
+            };
+            next_type = &typeid(M);
+        }
+
+#if SG_HAS_COROUTINES
+        // co_await ctx().sleep(0.2s) in an sg::script
+        template <typename Rep, typename Period>
+        sg::timer_wheel::sleep_awaiter sleep(std::chrono::duration<Rep, Period> d)
+        {
+            return timers_.sleep(d);
+        }
+#endif
+
     private:
-        context(void* window, uint32_t tex_width, uint32_t tex_height);
+        // creates a model in place at at, or with new if at is nullptr
+        typedef std::function<sg::model* (sg::context&, void* at)> model_factory;
+
+        context(void* window, uint32_t tex_width, uint32_t tex_height, uint64_t seed,
+                sg::job_system* jobs, sg::assets* assets,
+                model_factory first_model, std::type_info const& first_type);
+
+        // creates the first model, or the next one after restart()
+        std::unique_ptr<sg::model> create_model();
+        // true if it replaced model
+        bool apply_restart(std::unique_ptr<sg::model>& model);
+        // the same for a model living at at, which the next one must have
+        // the type of; model is nullptr if creating the next one throws
+        sg::model* create_model(void* at);
+        bool apply_restart(sg::model*& model, void* at);
 
         bool should_quit;
         void* window;
         uint32_t tex_width;
         uint32_t tex_height;
+        sg::random random_;
+        std::deque<std::pair<std::string, int64_t>> counters;
+        sg::job_system* jobs_;
+        sg::timer_wheel timers_;
+        sg::assets* assets_;
+        model_factory first_model;
+        std::type_info const* first_type;
+        model_factory next_model;
+        std::type_info const* next_type;
 
         friend void run(win_params const&);
+        template <typename M, typename... Args>
+        friend void run(win_params const&, Args&&... args);
+        friend struct headless;
+        friend struct window_loop;
     };
 
     struct model
     {
         model(context& ctx);
+        virtual ~model();
 
         context& ctx();
 
@@ -44,6 +138,7 @@ namespace sg
         {
             uint32_t frame_time; // milliseconds
             cairo_surface_t* surface;
+            sg::frame_arena* arena; // reset after draw returns
         };
 
         struct key_down_params
@@ -58,8 +153,14 @@ namespace sg
             Uint16 mod;
         };
 
+        // resize events are coalesced, at most one per frame
         struct resize_params
-        {};
+        {
+            uint32_t width;
+            uint32_t height;
+            uint32_t old_width;
+            uint32_t old_height;
+        };
 
         virtual void draw(draw_params const&);
         virtual void key_down(key_down_params const&);
@@ -86,22 +187,78 @@ namespace sg
         win_params& height(uint32_t value);
         win_params& resizing_policy(enum resizing_policy_t value);
         win_params& title(std::string title);
+        // format of the surface models draw into: CAIRO_FORMAT_ARGB32,
+        // opaque CAIRO_FORMAT_RGB24 or CAIRO_FORMAT_RGB16_565, which halves
+        // texture memory; defaults to SG_PIXEL_FORMAT=argb32|rgb24|rgb16_565
+        // from the environment
+        win_params& pixel_format(cairo_format_t value);
 
         win_params& min_frame_interval(uint32_t value);
+        // milliseconds between timing and input latency reports on
+        // std::clog, 0 disables; defaults to SG_STATS_INTERVAL from the
+        // environment
+        win_params& stats_interval(uint32_t value);
+        // flashes a marker on the frame that consumed a key press,
+        // defaults to SG_LATENCY_OVERLAY from the environment
+        win_params& latency_overlay(bool value);
+        // publishes frame statistics and context counters into the POSIX
+        // shared memory segment of this name for sg_stats and other
+        // readers, defaults to SG_STATS_SHM from the environment; starting
+        // fails while another live instance publishes under the same name
+        win_params& stats_shm(std::string name);
+        // reports every operator new call after the first warmup_frames
+        // frames, see alloc_audit.h, in a build with -DSG_ALLOC_AUDIT=ON;
+        // defaults to SG_ALLOC_AUDIT=warmup_frames from the environment
+        win_params& alloc_audit(uint32_t warmup_frames);
+
+        // threads of context::jobs() besides the one running the model,
+        // defaults to SG_WORKERS from the environment or to one less than
+        // the number of CPUs
+        win_params& workers(uint32_t value);
+        // binds every worker to a CPU of its own, defaults to
+        // SG_PIN_WORKERS from the environment
+        win_params& pin_workers(bool value);
+
+        // memory context::assets() keeps images in, in megabytes, defaults
+        // to SG_ASSET_MEMORY from the environment or to 256
+        win_params& asset_memory(uint32_t value);
+        // microseconds per frame spent uploading images to the GPU, at
+        // least one is uploaded per frame; defaults to SG_ASSET_BUDGET
+        // from the environment or to 2000
+        win_params& asset_budget(uint32_t value);
+
+        // seed of context::random(), defaults to SG_SEED from the
+        // environment or to a nondeterministic value
+        win_params& seed(uint64_t value);
+        // writes the seed, frame times and input of the session to a file,
+        // defaults to SG_RECORD from the environment
+        win_params& record(std::string path);
+        // feeds frame times and input from a recording instead of the
+        // real ones, the seed is taken from the recording as well;
+        // defaults to SG_REPLAY from the environment
+        win_params& replay(std::string path);
+        // writes every frame to a Y4M file if path ends in ".y4m", else to
+        // the PNG files path000001.png, ...; read back from the GPU and
+        // written on a thread of their own, frames are dropped rather than
+        // the game slowed down; defaults to SG_CAPTURE from the environment
+        win_params& capture(std::string path);
 
         template <typename M, typename... Args>
         win_params& model(Args&&... args)
         {
             using namespace std::placeholders;
-            model_creation_func_ = std::bind(&create_model<M, Args...>, _1, std::forward<Args>(args)...);
+            // bind keeps copies and passes them as lvalues, a model is
+            // created from them again on every restart
+            model_creation_func_ = std::bind(&create_model<M, std::decay_t<Args>...>, _1, _2, std::forward<Args>(args)...);
+            model_type_ = &typeid(M);
             return *this;
         }
 
     private:
         template <typename M, typename... Args>
-        static std::unique_ptr<sg::model> create_model(sg::context& ctx, Args&&... args)
+        static sg::model* create_model(sg::context& ctx, void* at, Args const&... args)
         {
-            return std::make_unique<M>(ctx, std::forward<Args>(args)...);
+            return at ? new (at) M(ctx, args...) : new M(ctx, args...);
         }
 
     private:
@@ -109,11 +266,237 @@ namespace sg
         uint32_t height_;
         resizing_policy_t resizing_policy_;
         std::string title_;
+        cairo_format_t pixel_format_;
 
         uint32_t min_frame_interval_;
+        uint32_t stats_interval_;
+        bool latency_overlay_;
+        std::string stats_shm_;
+        bool alloc_audit_;
+        uint32_t alloc_audit_warmup_;
+        uint32_t workers_;
+        bool pin_workers_;
+        uint32_t asset_memory_;
+        uint32_t asset_budget_;
+        uint64_t seed_;
+        std::string record_path_;
+        std::string replay_path_;
+        std::string capture_path_;
 
-        std::function<std::unique_ptr<sg::model> (sg::context&)> model_creation_func_;
+        std::function<sg::model* (sg::context&, void*)> model_creation_func_;
+        std::type_info const* model_type_;
 
         friend void run(win_params const&);
+        friend struct headless;
+        friend struct window_loop;
+    };
+
+    // Everything sg::run does around the calls of the model: the window,
+    // GL and cairo, recording and replay, pacing and statistics. run() and
+    // run<M>() share it and differ in how they hold the model and call it.
+    struct window_loop
+    {
+        window_loop(win_params const& p, context::model_factory first_model, std::type_info const& first_type);
+
+        window_loop(window_loop const&) = delete;
+        window_loop& operator=(window_loop const&) = delete;
+
+        ~window_loop();
+
+        sg::context& ctx();
+
+        // Runs frames until the model or the window quits. restart() is
+        // called before every frame and returns true if it replaced model.
+        template <typename M, typename Restart>
+        void frames(M*& model, Restart&& restart)
+        {
+            model_created();
+
+            input_event e;
+            while (begin_frame())
+            {
+                if (restart())
+                    restarted();
+
+                sg::model::resize_params rp;
+                if (resize(rp))
+                    call_resize(*model, rp);
+
+                while (replayed(e))
+                    dispatch(*model, e);
+
+                sg::model::draw_params dp;
+                if (!begin_draw(dp))
+                    break;
+                call_draw(*model, dp);
+                end_draw();
+
+                while (input(e))
+                    dispatch(*model, e);
+            }
+
+            finish();
+        }
+
+    private:
+        struct impl;
+
+        void model_created();
+        // false once the model or the window quit
+        bool begin_frame();
+        void restarted();
+        // true if the model is to be told about a resize
+        bool resize(sg::model::resize_params& rp);
+        // recorded input up to the next recorded frame
+        bool replayed(input_event& e);
+        // resizes the surface to a recorded size, true if the model is to
+        // be told about it
+        bool replayed_resize(input_event const& e, sg::model::resize_params& rp);
+        // false when the recording is over
+        bool begin_draw(sg::model::draw_params& dp);
+        void end_draw();
+        // input until the next frame is due: the recorded keys of the
+        // frame shown when replaying, live input otherwise
+        bool input(input_event& e);
+        void finish();
+
+        // True if M declares the hook or takes it from a base other than
+        // sg::model, whose draw, key_up and resize do nothing: a hook M
+        // leaves alone costs no call.
+        template <typename M>
+        static constexpr bool own_draw = !requires { { &M::draw } -> std::same_as<decltype(&sg::model::draw)>; };
+        template <typename M>
+        static constexpr bool own_key_up = !requires { { &M::key_up } -> std::same_as<decltype(&sg::model::key_up)>; };
+        template <typename M>
+        static constexpr bool own_resize = !requires { { &M::resize } -> std::same_as<decltype(&sg::model::resize)>; };
+
+        // Hooks of sg::model itself are called virtually, those of a type
+        // derived from it directly, unless M keeps them private.
+        template <typename M>
+        static void call_draw(M& model, sg::model::draw_params const& dp)
+        {
+            if constexpr (std::is_same_v<M, sg::model>)
+                model.draw(dp);
+            else if constexpr (!own_draw<M>)
+                return;
+            else if constexpr (requires { model.M::draw(dp); })
+                model.M::draw(dp);
+            else
+                static_cast<sg::model&>(model).draw(dp);
+        }
+
+        template <typename M>
+        static void call_key_down(M& model, sg::model::key_down_params const& kdp)
+        {
+            if constexpr (std::is_same_v<M, sg::model>)
+                model.key_down(kdp);
+            else if constexpr (requires { model.M::key_down(kdp); })
+                model.M::key_down(kdp);
+            else
+                static_cast<sg::model&>(model).key_down(kdp);
+        }
+
+        template <typename M>
+        static void call_key_up(M& model, sg::model::key_up_params const& kup)
+        {
+            if constexpr (std::is_same_v<M, sg::model>)
+                model.key_up(kup);
+            else if constexpr (!own_key_up<M>)
+                return;
+            else if constexpr (requires { model.M::key_up(kup); })
+                model.M::key_up(kup);
+            else
+                static_cast<sg::model&>(model).key_up(kup);
+        }
+
+        template <typename M>
+        static void call_resize(M& model, sg::model::resize_params const& rp)
+        {
+            if constexpr (std::is_same_v<M, sg::model>)
+                model.resize(rp);
+            else if constexpr (!own_resize<M>)
+                return;
+            else if constexpr (requires { model.M::resize(rp); })
+                model.M::resize(rp);
+            else
+                static_cast<sg::model&>(model).resize(rp);
+        }
+
+        // the only way input reaches a model, live or replayed, for run()
+        // and run<M>() alike
+        template <typename M>
+        void dispatch(M& model, input_event const& e)
+        {
+            switch (e.type)
+            {
+            case input_event::type_t::key_down:
+                {
+                    sg::model::key_down_params kdp;
+                    kdp.key = e.key;
+                    kdp.mod = e.mod;
+                    call_key_down(model, kdp);
+                    break;
+                }
+            case input_event::type_t::key_up:
+                {
+                    sg::model::key_up_params kup;
+                    kup.key = e.key;
+                    kup.mod = e.mod;
+                    call_key_up(model, kup);
+                    break;
+                }
+            case input_event::type_t::resize:
+                {
+                    sg::model::resize_params rp;
+                    if (replayed_resize(e, rp))
+                        call_resize(model, rp);
+                    break;
+                }
+            default:
+                break;
+            }
+        }
+
+        std::unique_ptr<impl> impl_;
     };
+
+    // sg::run for a model known at compile time: the M(ctx, args...) lives
+    // inside run<M>() rather than on the heap, and the loop calls its hooks
+    // directly, so that the compiler may inline them. Hooks M does not
+    // declare are left out, key_down() falls back to sg::model's. The model
+    // of p is ignored, args are copied and used again by restart().
+    template <typename M, typename... Args>
+    void run(win_params const& p, Args&&... args)
+    {
+        static_assert(std::is_base_of_v<sg::model, M>, "M must derive from sg::model");
+
+        context::model_factory create = [... args = std::decay_t<Args>(std::forward<Args>(args))](sg::context& ctx, void* at) -> sg::model*
+        {
+            return at ? new (at) M(ctx, args...) : new M(ctx, args...);
+        };
+        window_loop loop(p, std::move(create), typeid(M));
+
+        // destroys the model before the loop, as run() does
+        struct holder
+        {
+            alignas(M) unsigned char storage[sizeof(M)];
+            sg::model* current = nullptr;
+
+            ~holder()
+            {
+                if (current)
+                    current->~model();
+            }
+        } model;
+
+        model.current = loop.ctx().create_model(model.storage);
+        M* m = static_cast<M*>(model.current);
+        loop.frames(m, [&]
+        {
+            if (!loop.ctx().apply_restart(model.current, model.storage))
+                return false;
+            m = static_cast<M*>(model.current);
+            return true;
+        });
+    }
 }
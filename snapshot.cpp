@@ -0,0 +1,331 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+using namespace sg;
+
+namespace
+{
+    // deltas between key images, in images: more restores a little
+    // slower, fewer takes more of the ring
+    constexpr size_t key_interval = 4;
+
+    size_t words(size_t bytes)
+    {
+        return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    }
+
+    // a run header: zero words to skip, then literal words to XOR
+    uint64_t run(size_t zeros, size_t literals)
+    {
+        return static_cast<uint64_t>(zeros) << 32 | literals;
+    }
+}
+
+snapshot::snapshot(size_t ticks, size_t ring_bytes)
+    : records(std::max<size_t>(ticks, 1))
+    , first(0)
+    , count(0)
+    , ring(words(ring_bytes))
+    , current_tick(0)
+    , has_current(false)
+    , since_key(SIZE_MAX)
+{}
+
+void snapshot::add(std::function<size_t ()> size,
+                   std::function<void (unsigned char*)> save,
+                   std::function<void (unsigned char const*, size_t)> load)
+{
+    // the images of the ticks saved so far no longer match the blocks
+    assert(!has_current);
+    blocks.push_back(block{std::move(size), std::move(save), std::move(load)});
+}
+
+void snapshot::save(uint64_t tick)
+{
+    assert(!has_current || tick > current_tick);
+
+    write_image(next);
+    if (has_current)
+    {
+        size_t length = encode();
+        if (count == records.size())
+        {
+            first = (first + 1) % records.size();
+            --count;
+        }
+
+        since_key = since_key < SIZE_MAX - length ? since_key + length : SIZE_MAX;
+        size_t key = since_key >= key_interval * current.size() && length + current.size() <= ring.size()
+                   ? current.size() : 0;
+
+        size_t offset;
+        if (allocate(length + key, offset))
+        {
+            std::copy(encoded.begin(), encoded.begin() + length, ring.begin() + offset);
+            std::copy(current.begin(), current.begin() + key, ring.begin() + offset + length);
+            records[(first + count) % records.size()] = record{current_tick, offset, length, key, current.size()};
+            ++count;
+            if (key != 0)
+                since_key = 0;
+        }
+    }
+
+    std::swap(current, next);
+    current_tick = tick;
+    has_current = true;
+}
+
+bool snapshot::restore(uint64_t tick)
+{
+    if (!has_current || tick > current_tick || tick < oldest())
+        return false;
+
+    if (tick != current_tick)
+    {
+        // ticks may have gaps
+        size_t j = count;
+        while (j != 0 && at(j - 1).tick > tick)
+            --j;
+        if (j == 0 || at(j - 1).tick != tick)
+            return false;
+        --j;
+
+        // the cheapest start in words: the newest image, or a key image
+        // after j going back, or one at or before j going forward
+        size_t back = 0;
+        for (size_t r = j; r != count; ++r)
+            back += at(r).length;
+        size_t start = count;
+        size_t best = back;
+        size_t deltas = 0;
+        for (size_t r = j; r != count && deltas < best; ++r)
+        {
+            if (r != j && at(r).key != 0 && at(r).key + deltas < best)
+            {
+                start = r;
+                best = at(r).key + deltas;
+            }
+            deltas += at(r).length;
+        }
+        deltas = 0;
+        for (size_t r = j + 1; r-- != 0 && deltas < best;)
+        {
+            if (at(r).key != 0 && at(r).key + deltas < best)
+            {
+                start = r;
+                best = at(r).key + deltas;
+            }
+            if (r != 0)
+                deltas += at(r - 1).length;
+        }
+
+        if (start != count)
+        {
+            record const& k = at(start);
+            current.assign(ring.begin() + k.offset + k.length, ring.begin() + k.offset + k.length + k.key);
+        }
+        if (start > j)
+        {
+            for (size_t r = start; r-- != j;)
+                apply(at(r), at(r).image);
+        }
+        else
+        {
+            for (size_t r = start; r != j; ++r)
+                apply(at(r), at(r + 1).image);
+        }
+
+        current_tick = tick;
+        count = j;
+        since_key = SIZE_MAX;
+    }
+
+    read_image(current);
+    return true;
+}
+
+bool snapshot::empty() const
+{
+    return !has_current;
+}
+
+uint64_t snapshot::oldest() const
+{
+    assert(has_current);
+    return count != 0 ? records[first].tick : current_tick;
+}
+
+uint64_t snapshot::latest() const
+{
+    assert(has_current);
+    return current_tick;
+}
+
+void snapshot::clear()
+{
+    first = 0;
+    count = 0;
+    has_current = false;
+    since_key = SIZE_MAX;
+}
+
+size_t snapshot::state_bytes() const
+{
+    return current.size() * sizeof(uint64_t);
+}
+
+size_t snapshot::delta_bytes() const
+{
+    if (count == 0)
+        return 0;
+
+    record const& oldest = records[first];
+    record const& newest = records[(first + count - 1) % records.size()];
+    size_t end = newest.offset + newest.length + newest.key;
+    size_t used = newest.offset >= oldest.offset ? end - oldest.offset : ring.size() - oldest.offset + end;
+    return used * sizeof(uint64_t);
+}
+
+// every block is its size in bytes, then its bytes padded to a word
+void snapshot::write_image(std::vector<uint64_t>& image) const
+{
+    size_t total = 0;
+    for (block const& b : blocks)
+        total += 1 + words(b.size());
+    image.resize(total);
+
+    size_t w = 0;
+    for (block const& b : blocks)
+    {
+        size_t size = b.size();
+        size_t n = words(size);
+        image[w] = size;
+        if (n != 0)
+            image[w + n] = 0;
+        b.save(reinterpret_cast<unsigned char*>(image.data() + w + 1));
+        w += 1 + n;
+    }
+}
+
+void snapshot::read_image(std::vector<uint64_t> const& image)
+{
+    size_t w = 0;
+    for (block const& b : blocks)
+    {
+        assert(w < image.size());
+        size_t size = image[w];
+        b.load(reinterpret_cast<unsigned char const*>(image.data() + w + 1), size);
+        w += 1 + words(size);
+    }
+}
+
+size_t snapshot::encode()
+{
+    // the shorter image is padded with zeros for the while
+    size_t current_size = current.size();
+    size_t next_size = next.size();
+    size_t n = std::max(current_size, next_size);
+    current.resize(n, 0);
+    next.resize(n, 0);
+    uint64_t const* a = current.data();
+    uint64_t const* b = next.data();
+
+    // a literal word takes two at most, with its run header
+    if (encoded.size() < n + n / 2 + 2)
+        encoded.resize(n + n / 2 + 2);
+    uint64_t* out = encoded.data();
+    size_t i = 0;
+    size_t last = 0; // end of the previous literals
+    while (i != n)
+    {
+        if ((a[i] ^ b[i]) == 0)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t start = i;
+        uint64_t* header = out++;
+        for (; i != n && (a[i] ^ b[i]) != 0; ++i)
+            *out++ = a[i] ^ b[i];
+        *header = run(start - last, i - start);
+        last = i;
+    }
+
+    // an empty run keeps every record in the ring at a place of its own
+    if (out == encoded.data())
+        *out++ = run(0, 0);
+
+    current.resize(current_size);
+    next.resize(next_size);
+    return out - encoded.data();
+}
+
+bool snapshot::allocate(size_t length, size_t& offset)
+{
+    if (length > ring.size())
+    {
+        count = 0;
+        return false;
+    }
+
+    for (;; first = (first + 1) % records.size(), --count)
+    {
+        if (count == 0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        record const& oldest = records[first];
+        record const& newest = records[(first + count - 1) % records.size()];
+        size_t head = newest.offset + newest.length + newest.key;
+        size_t tail = oldest.offset;
+        if (newest.offset >= oldest.offset)
+        {
+            // free at the end, then at the start
+            if (ring.size() - head >= length)
+            {
+                offset = head;
+                return true;
+            }
+            if (tail >= length)
+            {
+                offset = 0;
+                return true;
+            }
+        }
+        else if (tail - head >= length)
+        {
+            offset = head;
+            return true;
+        }
+    }
+}
+
+// current ^= the delta of r, current ends up size words long
+void snapshot::apply(record const& r, size_t size)
+{
+    current.resize(std::max(current.size(), size), 0);
+    uint64_t const* p = ring.data() + r.offset;
+    uint64_t const* end = p + r.length;
+    size_t w = 0;
+    while (p != end)
+    {
+        w += *p >> 32;
+        size_t n = *p++ & 0xffffffff;
+        for (size_t i = 0; i != n; ++i)
+            current[w + i] ^= p[i];
+        w += n;
+        p += n;
+    }
+    current.resize(size);
+}
+
+snapshot::record& snapshot::at(size_t i)
+{
+    return records[(first + i) % records.size()];
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace sg
+{
+    // The last ticks of a model's state, for rewind and rollback.
+    //
+    // The model declares its state once as blocks: trivially copyable
+    // objects, vectors of them, or anything that writes itself to bytes.
+    // save() after every tick puts the blocks one after the other into an
+    // image and keeps the newest one whole; older ticks are the XOR of
+    // their image with the next one, run length encoded over 8 byte words,
+    // so the words a tick left alone cost nothing. Whenever the deltas
+    // since add up to a few images, a tick keeps its image too. restore()
+    // starts from the newest image or a kept one, whichever leaves the
+    // fewest words to XOR, and goes tick by tick from there: a few images'
+    // worth of words at worst, however far back.
+    //
+    // The deltas share one preallocated byte ring and the oldest ticks go
+    // when it is full, so how far back restore() reaches depends on how
+    // much the state moves. A vector block takes the room of its capacity
+    // in the image, so that reserving keeps it from shifting the blocks
+    // after it.
+    struct snapshot
+    {
+        // at most ticks past ticks, in ring_bytes of deltas
+        snapshot(size_t ticks, size_t ring_bytes);
+
+        snapshot(snapshot const&) = delete;
+        snapshot& operator=(snapshot const&) = delete;
+
+        template <typename T>
+        void add(T& block)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "blocks must be trivially copyable");
+
+            T* p = &block;
+            add([] { return sizeof(T); },
+                [p](unsigned char* out) { std::memcpy(out, p, sizeof(T)); },
+                [p](unsigned char const* in, size_t) { std::memcpy(p, in, sizeof(T)); });
+        }
+
+        template <typename T>
+        void add(std::vector<T>& block)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "blocks must be trivially copyable");
+
+            std::vector<T>* v = &block;
+            add([v] { return sizeof(uint64_t) + v->capacity() * sizeof(T); },
+                [v](unsigned char* out)
+                {
+                    uint64_t n = v->size();
+                    std::memcpy(out, &n, sizeof(n));
+                    if (n != 0)
+                        std::memcpy(out + sizeof(n), v->data(), n * sizeof(T));
+                    std::memset(out + sizeof(n) + n * sizeof(T), 0, (v->capacity() - n) * sizeof(T));
+                },
+                [v](unsigned char const* in, size_t)
+                {
+                    uint64_t n;
+                    std::memcpy(&n, in, sizeof(n));
+                    v->resize(n);
+                    if (n != 0)
+                        std::memcpy(v->data(), in + sizeof(n), n * sizeof(T));
+                });
+        }
+
+        // A block of size() bytes that save() writes and load() reads back
+        // from as many.
+        void add(std::function<size_t ()> size,
+                 std::function<void (unsigned char*)> save,
+                 std::function<void (unsigned char const*, size_t)> load);
+
+        // Records the blocks as they are for tick, which comes after the
+        // ticks saved before.
+        void save(uint64_t tick);
+
+        // Puts the blocks back as they were at tick and forgets the ticks
+        // after it, which the model simulates again; false if tick is no
+        // longer or not yet saved.
+        bool restore(uint64_t tick);
+
+        bool empty() const;
+        // the range restore() takes, valid if !empty()
+        uint64_t oldest() const;
+        uint64_t latest() const;
+
+        void clear();
+
+        // size of the newest image
+        size_t state_bytes() const;
+        // ring bytes the deltas take
+        size_t delta_bytes() const;
+
+    private:
+        struct block
+        {
+            std::function<size_t ()> size;
+            std::function<void (unsigned char*)> save;
+            std::function<void (unsigned char const*, size_t)> load;
+        };
+
+        // the delta between the images of tick and the next tick, then
+        // maybe the image of tick, in words
+        struct record
+        {
+            uint64_t tick;
+            size_t offset; // in ring
+            size_t length; // of the delta
+            size_t key; // of the image, 0 for none
+            size_t image; // of tick
+        };
+
+        void write_image(std::vector<uint64_t>& image) const;
+        void read_image(std::vector<uint64_t> const& image);
+        // encoded = current ^ next, returns its length
+        size_t encode();
+        void apply(record const& r, size_t size);
+        // room for length words in ring, dropping the oldest records
+        bool allocate(size_t length, size_t& offset);
+        record& at(size_t i);
+
+        std::vector<block> blocks;
+        // oldest first, a ring of their own
+        std::vector<record> records;
+        size_t first;
+        size_t count;
+        std::vector<uint64_t> ring;
+        std::vector<uint64_t> encoded;
+        // the newest image, its tick, and the one save() writes
+        std::vector<uint64_t> current;
+        uint64_t current_tick;
+        bool has_current;
+        // delta words since the last key image
+        size_t since_key;
+        std::vector<uint64_t> next;
+    };
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sg
+{
+    // Shortest signed distance from a to b along an axis of the unit torus,
+    // in [-0.5, 0.5].
+    inline double torus_delta(double a, double b)
+    {
+        double d = b - a;
+        return d - std::floor(d + 0.5);
+    }
+
+    // Uniform grid over the unit torus [0, 1)^2 for broad phase collision
+    // tests.
+    //
+    // Every frame: clear(), insert() the objects, build(), then query().
+    // build() is a counting sort into the cells, O(n) and without
+    // allocation once the grid has seen as many objects before. A query
+    // visits the cells its circle overlaps, wrapping around the edges, so
+    // objects on either side of the seam find each other; every object is
+    // visited once at most.
+    template <typename T>
+    struct spatial_grid
+    {
+        // cells are at least cell_size wide, queries with a radius up to
+        // cell_size visit at most 3x3 cells
+        explicit spatial_grid(double cell_size)
+            : side(std::max<int32_t>(1, static_cast<int32_t>(1. / cell_size)))
+            , cell_start(static_cast<size_t>(side) * side + 1, 0)
+            , built(false)
+        {}
+
+        void reserve(size_t n)
+        {
+            items.reserve(n);
+            sorted.reserve(n);
+        }
+
+        void clear()
+        {
+            items.clear();
+            sorted.clear();
+            built = false;
+        }
+
+        // x and y in [0, 1]
+        void insert(double x, double y, T value)
+        {
+            assert(!built);
+            items.push_back(item{x, y, cell_of(x, y), value});
+        }
+
+        void build()
+        {
+            std::fill(cell_start.begin(), cell_start.end(), 0);
+            for (item const& i : items)
+                ++cell_start[i.cell + 1];
+            for (size_t c = 1; c != cell_start.size(); ++c)
+                cell_start[c] += cell_start[c - 1];
+
+            // cell_start[c] is the start of cell c, then the next free
+            // place of cell c while scattering, which leaves it at the end
+            // of cell c; shifted by one it is the start of cell c again
+            sorted.resize(items.size());
+            for (item const& i : items)
+                sorted[cell_start[i.cell]++] = i;
+            for (size_t c = cell_start.size() - 1; c != 0; --c)
+                cell_start[c] = cell_start[c - 1];
+            cell_start[0] = 0;
+
+            built = true;
+        }
+
+        size_t size() const
+        {
+            return items.size();
+        }
+
+        // Calls f(value, dx, dy) for the objects in the cells around the
+        // circle, (dx, dy) being the shortest offset from (x, y) to the
+        // object; f returns false to stop. Objects farther away than
+        // radius may be visited too, the caller does the exact test.
+        template <typename F>
+        void query(double x, double y, double radius, F&& f) const
+        {
+            assert(built);
+
+            int32_t x0 = static_cast<int32_t>(std::floor((x - radius) * side));
+            int32_t x1 = static_cast<int32_t>(std::floor((x + radius) * side));
+            int32_t y0 = static_cast<int32_t>(std::floor((y - radius) * side));
+            int32_t y1 = static_cast<int32_t>(std::floor((y + radius) * side));
+            // a wider range would visit cells twice
+            if (x1 - x0 >= side)
+            {
+                x0 = 0;
+                x1 = side - 1;
+            }
+            if (y1 - y0 >= side)
+            {
+                y0 = 0;
+                y1 = side - 1;
+            }
+
+            for (int32_t cy = y0; cy <= y1; ++cy)
+            {
+                int32_t row = wrap(cy) * side;
+                for (int32_t cx = x0; cx <= x1; ++cx)
+                {
+                    size_t c = static_cast<size_t>(row + wrap(cx));
+                    for (uint32_t i = cell_start[c]; i != cell_start[c + 1]; ++i)
+                    {
+                        item const& it = sorted[i];
+                        if (!f(it.value, torus_delta(x, it.x), torus_delta(y, it.y)))
+                            return;
+                    }
+                }
+            }
+        }
+
+    private:
+        struct item
+        {
+            double x;
+            double y;
+            uint32_t cell;
+            T value;
+        };
+
+        int32_t wrap(int32_t c) const
+        {
+            c %= side;
+            return c < 0 ? c + side : c;
+        }
+
+        uint32_t cell_of(double x, double y) const
+        {
+            // 1.0 and rounding below 0 fold back onto the torus
+            int32_t cx = wrap(static_cast<int32_t>(std::floor(x * side)));
+            int32_t cy = wrap(static_cast<int32_t>(std::floor(y * side)));
+            return static_cast<uint32_t>(cy * side + cx);
+        }
+
+    private:
+        int32_t side;
+        std::vector<item> items;
+        std::vector<item> sorted;
+        std::vector<uint32_t> cell_start;
+        bool built;
+    };
+}
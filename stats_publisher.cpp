@@ -0,0 +1,158 @@
+#include "stats_publisher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sg;
+
+namespace
+{
+    constexpr uint64_t percentile_period = 16;
+
+    double percentile(uint32_t const* sorted, size_t n, double p)
+    {
+        return sorted[static_cast<size_t>(p * (n - 1) + 0.5)];
+    }
+
+    // pid of the process publishing into an existing segment, 0 when the
+    // segment is not a stats page or its publisher is gone (crashed
+    // without unlinking it)
+    pid_t live_publisher(std::string const& name)
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return 0;
+        void* addr = MAP_FAILED;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(shm_stats)))
+            addr = mmap(nullptr, sizeof(shm_stats), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            return 0;
+
+        auto const* s = static_cast<shm_stats const*>(addr);
+        pid_t pid = s->magic == shm_stats::magic_value ? static_cast<pid_t>(s->pid) : 0;
+        munmap(addr, sizeof(shm_stats));
+
+        if (pid > 0 && (kill(pid, 0) == 0 || errno == EPERM))
+            return pid;
+        return 0;
+    }
+}
+
+stats_publisher::stats_publisher(std::string name)
+    : name(name.empty() || name[0] != '/' ? "/" + name : name)
+    , page(nullptr)
+    , frame(0)
+    , window_sum(0)
+{
+    std::fill(std::begin(frame_times), std::end(frame_times), 0);
+
+    // O_EXCL so a second instance publishing under the same name fails
+    // here instead of sharing the page, and unlinking it on exit; a page
+    // left behind by a crashed publisher is reclaimed
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST)
+    {
+        pid_t owner = live_publisher(this->name);
+        if (owner != 0)
+        {
+            std::stringstream ss;
+            ss << "shared memory segment " << this->name << " is in use by process " << owner
+               << ", choose another SG_STATS_SHM name";
+            throw std::runtime_error(ss.str());
+        }
+        shm_unlink(this->name.c_str());
+        fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0)
+    {
+        std::stringstream ss;
+        ss << "failed to create shared memory segment " << this->name;
+        throw std::runtime_error(ss.str());
+    }
+
+    void* addr = MAP_FAILED;
+    if (ftruncate(fd, sizeof(shm_stats)) == 0)
+        addr = mmap(nullptr, sizeof(shm_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(this->name.c_str());
+        std::stringstream ss;
+        ss << "failed to map shared memory segment " << this->name;
+        throw std::runtime_error(ss.str());
+    }
+
+    page = new (addr) shm_stats();
+    page->pid = getpid();
+    page->version = shm_stats::current_version;
+    page->magic = shm_stats::magic_value;
+}
+
+stats_publisher::~stats_publisher()
+{
+    munmap(page, sizeof(shm_stats));
+    shm_unlink(name.c_str());
+}
+
+void stats_publisher::publish(uint32_t frame_time,
+                              uint32_t tex_width,
+                              uint32_t tex_height,
+                              std::deque<std::pair<std::string, int64_t>> const& counters)
+{
+    uint32_t& slot = frame_times[frame % window];
+    window_sum += frame_time;
+    window_sum -= slot;
+    slot = frame_time;
+    ++frame;
+
+    size_t n = frame < window ? frame : window;
+
+    bool update_percentiles = frame % percentile_period == 0 || frame < percentile_period;
+    uint32_t sorted[window];
+    if (update_percentiles)
+    {
+        std::copy(frame_times, frame_times + n, sorted);
+        std::sort(sorted, sorted + n);
+    }
+
+    shm_stats::data_t& d = page->data;
+    shm_stats_write_begin(*page);
+
+    d.frame = frame;
+    d.fps = window_sum != 0 ? n * 1000. / window_sum : 0.;
+    d.frame_time = frame_time;
+    if (update_percentiles)
+    {
+        d.frame_time_p50 = percentile(sorted, n, 0.5);
+        d.frame_time_p90 = percentile(sorted, n, 0.9);
+        d.frame_time_p99 = percentile(sorted, n, 0.99);
+        d.frame_time_max = sorted[n - 1];
+    }
+    d.tex_width = tex_width;
+    d.tex_height = tex_height;
+
+    d.counter_count = counters.size() < shm_stats::max_counters ? counters.size() : shm_stats::max_counters;
+    for (size_t i = 0; i != d.counter_count; ++i)
+    {
+        shm_stats::counter& c = d.counters[i];
+        std::string const& counter_name = counters[i].first;
+        size_t len = std::min(counter_name.size(), shm_stats::name_size - 1);
+        std::copy(counter_name.begin(), counter_name.begin() + len, c.name);
+        c.name[len] = '\0';
+        c.value = counters[i].second;
+    }
+
+    shm_stats_write_end(*page);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "stats_shm.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+
+namespace sg
+{
+    // Owns the shared memory segment of shm_stats and publishes one frame
+    // at a time into it. Percentiles are taken over the last window frames
+    // and recomputed every few frames only, so a frame costs a copy of the
+    // counters and nothing more.
+    struct stats_publisher
+    {
+        static constexpr size_t window = 128;
+
+        explicit stats_publisher(std::string name);
+
+        stats_publisher(stats_publisher const&) = delete;
+        stats_publisher& operator=(stats_publisher const&) = delete;
+
+        ~stats_publisher();
+
+        void publish(uint32_t frame_time,
+                     uint32_t tex_width,
+                     uint32_t tex_height,
+                     std::deque<std::pair<std::string, int64_t>> const& counters);
+
+    private:
+        std::string name;
+        shm_stats* page;
+        uint64_t frame;
+        uint32_t frame_times[window];
+        uint64_t window_sum;
+    };
+}
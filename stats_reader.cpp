@@ -0,0 +1,83 @@
+#include "stats_shm.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Prints the counters a running sg::run publishes with win_params::stats_shm.
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "usage: " << argv[0] << " NAME [INTERVAL_MS]" << std::endl;
+        return 2;
+    }
+
+    std::string name = argv[1];
+    if (name[0] != '/')
+        name = "/" + name;
+    unsigned interval = argc == 3 ? std::strtoul(argv[2], nullptr, 10) : 500;
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        std::cerr << "no shared memory segment " << name << std::endl;
+        return 1;
+    }
+
+    void* addr = mmap(nullptr, sizeof(sg::shm_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "failed to map " << name << std::endl;
+        return 1;
+    }
+
+    sg::shm_stats const& page = *static_cast<sg::shm_stats const*>(addr);
+    if (page.magic != sg::shm_stats::magic_value || page.version != sg::shm_stats::current_version)
+    {
+        std::cerr << name << " is not a supported stats segment" << std::endl;
+        return 1;
+    }
+
+    sg::shm_stats::data_t d;
+    uint64_t last_frame = 0;
+    for (;;)
+    {
+        while (!sg::shm_stats_try_read(page, d))
+            std::this_thread::yield();
+
+        if (d.frame != last_frame || d.frame == 0)
+        {
+            std::cout << std::fixed << std::setprecision(1)
+                      << "pid " << page.pid
+                      << " frame " << d.frame
+                      << " fps " << d.fps
+                      << " frame ms " << d.frame_time
+                      << " p50/p90/p99/max " << d.frame_time_p50
+                      << '/' << d.frame_time_p90
+                      << '/' << d.frame_time_p99
+                      << '/' << d.frame_time_max
+                      << " texture " << d.tex_width << 'x' << d.tex_height;
+            for (uint32_t i = 0; i != d.counter_count; ++i)
+                std::cout << ' ' << d.counters[i].name << ' ' << d.counters[i].value;
+            std::cout << std::endl;
+        }
+        else if (kill(page.pid, 0) != 0)
+        {
+            std::cerr << "process " << page.pid << " is gone" << std::endl;
+            return 0;
+        }
+        last_frame = d.frame;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace sg
+{
+    // Layout of the POSIX shared memory segment sg::run publishes live
+    // counters in. It is written by one process and read by any number of
+    // others without locks: the writer makes seq odd while it updates data,
+    // a reader retries when seq was odd or changed during its copy.
+    struct shm_stats
+    {
+        static constexpr uint32_t magic_value = 0x54534753; // "SGST"
+        static constexpr uint32_t current_version = 1;
+        static constexpr size_t max_counters = 32;
+        static constexpr size_t name_size = 32;
+
+        struct counter
+        {
+            char name[name_size];
+            int64_t value;
+        };
+
+        struct data_t
+        {
+            uint64_t frame;
+            double fps;
+            double frame_time;   // milliseconds, last frame
+            double frame_time_p50;
+            double frame_time_p90;
+            double frame_time_p99;
+            double frame_time_max;
+            uint32_t tex_width;
+            uint32_t tex_height;
+            uint32_t counter_count;
+            uint32_t reserved;
+            counter counters[max_counters];
+        };
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pid;
+        std::atomic<uint32_t> seq;
+        data_t data;
+    };
+
+    inline void shm_stats_write_begin(shm_stats& s)
+    {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    inline void shm_stats_write_end(shm_stats& s)
+    {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // false if the writer was updating the data, the caller should retry
+    inline bool shm_stats_try_read(shm_stats const& s, shm_stats::data_t& out)
+    {
+        uint32_t before = s.seq.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+
+        std::memcpy(&out, const_cast<shm_stats::data_t const*>(&s.data), sizeof out);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return s.seq.load(std::memory_order_relaxed) == before;
+    }
+}
@@ -0,0 +1,255 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace sg;
+
+timer_wheel::timer_wheel()
+    : free_head(nil)
+    , count(0)
+    , now_(0)
+    , next_seq(0)
+{
+    for (size_t level = 0; level != levels; ++level)
+        for (size_t slot = 0; slot != slots; ++slot)
+            wheel[level][slot] = list{nil, nil};
+}
+
+timer_wheel::timer_id timer_wheel::after(duration delay, std::function<void ()> f)
+{
+    return schedule(std::max<int64_t>(delay.count(), 1), 0, std::move(f));
+}
+
+timer_wheel::timer_id timer_wheel::every(duration period, std::function<void ()> f)
+{
+    uint64_t p = std::max<int64_t>(period.count(), 1);
+    return schedule(p, p, std::move(f));
+}
+
+void timer_wheel::cancel(timer_id id)
+{
+    if (id.index >= nodes.size() || nodes[id.index].generation != id.generation)
+        return;
+
+    node& n = nodes[id.index];
+    switch (n.st)
+    {
+    case state::scheduled:
+        unlink(id.index);
+        release(id.index);
+        break;
+    case state::firing:
+        // fire() releases it once the callback returned
+        n.st = state::cancelled;
+        break;
+    default:
+        break;
+    }
+}
+
+bool timer_wheel::pending(timer_id id) const
+{
+    if (id.index >= nodes.size() || nodes[id.index].generation != id.generation)
+        return false;
+
+    node const& n = nodes[id.index];
+    return n.st == state::scheduled || (n.st == state::firing && n.period != 0);
+}
+
+size_t timer_wheel::size() const
+{
+    return count;
+}
+
+void timer_wheel::clear()
+{
+    for (uint32_t i = 0; i != nodes.size(); ++i)
+    {
+        assert(nodes[i].st != state::firing && nodes[i].st != state::cancelled);
+        if (nodes[i].st == state::scheduled)
+        {
+            unlink(i);
+            release(i);
+        }
+    }
+}
+
+void timer_wheel::advance(duration d)
+{
+    for (int64_t tick = 0; tick < d.count(); ++tick)
+    {
+        if (count == 0)
+        {
+            now_ += d.count() - tick;
+            return;
+        }
+
+        ++now_;
+
+        // coarse levels first, so that timers cascading from level 2 into
+        // the current slot of level 1 move on to level 0 right away
+        for (size_t level = levels - 1; level != 0; --level)
+            if ((now_ & ((uint64_t(1) << (level * slot_bits)) - 1)) == 0)
+                cascade(level);
+
+        list& due = wheel[0][now_ & (slots - 1)];
+        while (due.head != nil)
+        {
+            uint32_t i = due.head;
+            unlink(i);
+            fire(i);
+        }
+    }
+}
+
+timer_wheel::duration timer_wheel::now() const
+{
+    return duration(now_);
+}
+
+timer_wheel::duration timer_wheel::time_to_next() const
+{
+    if (count == 0)
+        return duration::max();
+
+    uint64_t best = UINT64_MAX;
+
+    // level 0 holds exact deadlines, coarser levels give the start of the
+    // slot's span
+    for (size_t level = 0; level != levels; ++level)
+    {
+        size_t shift = level * slot_bits;
+        uint64_t current = now_ >> shift;
+        for (uint64_t j = 1; j <= slots; ++j)
+        {
+            if (wheel[level][(current + j) & (slots - 1)].head == nil)
+                continue;
+
+            uint64_t start = (current + j) << shift;
+            best = std::min(best, start > now_ ? start - now_ : 1);
+            break;
+        }
+    }
+
+    return duration(best);
+}
+
+timer_wheel::timer_id timer_wheel::schedule(uint64_t delay, uint64_t period, std::function<void ()> f)
+{
+    uint32_t i = free_head;
+    if (i != nil)
+        free_head = nodes[i].next;
+    else
+    {
+        i = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        nodes.back().generation = 0;
+    }
+
+    node& n = nodes[i];
+    n.f = std::move(f);
+    n.deadline = now_ + delay;
+    n.period = period;
+    n.seq = next_seq++;
+    n.st = state::scheduled;
+    ++count;
+    insert(i);
+
+    return timer_id{i, n.generation};
+}
+
+void timer_wheel::insert(uint32_t i)
+{
+    node& n = nodes[i];
+    // 0 when cascaded into the slot that fires in this tick
+    uint64_t delta = n.deadline - now_;
+
+    size_t level = 0;
+    while (level + 1 != levels && delta >= (uint64_t(1) << ((level + 1) * slot_bits)))
+        ++level;
+
+    // deadlines beyond the last level come back to it when cascaded
+    n.level = static_cast<uint8_t>(level);
+    n.slot = static_cast<uint8_t>((n.deadline >> (level * slot_bits)) & (slots - 1));
+
+    // ordered by seq: a timer cascading into a slot goes ahead of those
+    // scheduled into it directly after it, which are the only ones it has
+    // to walk past
+    list& l = wheel[n.level][n.slot];
+    uint32_t prev = l.tail;
+    while (prev != nil && nodes[prev].seq > n.seq)
+        prev = nodes[prev].prev;
+
+    n.prev = prev;
+    n.next = prev != nil ? nodes[prev].next : l.head;
+    if (prev != nil)
+        nodes[prev].next = i;
+    else
+        l.head = i;
+    if (n.next != nil)
+        nodes[n.next].prev = i;
+    else
+        l.tail = i;
+}
+
+void timer_wheel::unlink(uint32_t i)
+{
+    node& n = nodes[i];
+    list& l = wheel[n.level][n.slot];
+
+    if (n.prev != nil)
+        nodes[n.prev].next = n.next;
+    else
+        l.head = n.next;
+
+    if (n.next != nil)
+        nodes[n.next].prev = n.prev;
+    else
+        l.tail = n.prev;
+}
+
+void timer_wheel::release(uint32_t i)
+{
+    node& n = nodes[i];
+    n.f = nullptr;
+    n.st = state::free;
+    ++n.generation;
+    n.next = free_head;
+    free_head = i;
+    --count;
+}
+
+void timer_wheel::cascade(size_t level)
+{
+    // detached first, a timer can land in the same slot again
+    list& l = wheel[level][(now_ >> (level * slot_bits)) & (slots - 1)];
+    uint32_t i = l.head;
+    l = list{nil, nil};
+
+    while (i != nil)
+    {
+        uint32_t next = nodes[i].next;
+        insert(i);
+        i = next;
+    }
+}
+
+void timer_wheel::fire(uint32_t i)
+{
+    nodes[i].st = state::firing;
+    nodes[i].f();
+
+    node& n = nodes[i];
+    if (n.st == state::firing && n.period != 0)
+    {
+        n.st = state::scheduled;
+        n.seq = next_seq++;
+        n.deadline += n.period;
+        if (n.deadline <= now_)
+            n.deadline = now_ + 1;
+        insert(i);
+    }
+    else
+        release(i);
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+#define SG_HAS_COROUTINES 1
+#include <coroutine>
+#else
+#define SG_HAS_COROUTINES 0
+#endif
+
+namespace sg
+{
+    // Hierarchical timer wheel with a resolution of a millisecond.
+    //
+    // Time is model time: it moves only by advance(), which sg::run calls
+    // with the frame time before every frame, so timers replay exactly.
+    // Four levels of 256 slots cover 2^32 ms; scheduling and cancelling
+    // are O(1), and a timer is moved to a finer level at most three times
+    // before it fires, so thousands of timers cost O(1) per tick rather
+    // than a countdown each per frame.
+    //
+    // Callbacks run inside advance(), in deadline order, timers with the
+    // same deadline in the order they were scheduled. They may schedule
+    // and cancel timers, including their own.
+    struct timer_wheel
+    {
+        typedef std::chrono::milliseconds duration;
+
+        struct timer_id
+        {
+            uint32_t index;
+            uint32_t generation;
+
+            bool operator==(timer_id other) const
+            {
+                return index == other.index && generation == other.generation;
+            }
+
+            bool operator!=(timer_id other) const
+            {
+                return !(*this == other);
+            }
+        };
+
+        static constexpr timer_id null_timer()
+        {
+            return timer_id{UINT32_MAX, 0};
+        }
+
+        timer_wheel();
+
+        timer_wheel(timer_wheel const&) = delete;
+        timer_wheel& operator=(timer_wheel const&) = delete;
+
+        // fires once after delay, a delay of 0 fires on the next advance()
+        timer_id after(duration delay, std::function<void ()> f);
+        // fires every period, the first time after one period
+        timer_id every(duration period, std::function<void ()> f);
+
+        // does nothing if the timer already fired or was cancelled
+        void cancel(timer_id id);
+        // whether the timer fires in the future
+        bool pending(timer_id id) const;
+        size_t size() const;
+        // cancels every timer, not to be called from a callback
+        void clear();
+
+        void advance(duration d);
+        duration now() const;
+
+        // Time until the earliest deadline, or duration::max() if no timer
+        // is pending. May be earlier than the actual deadline, never later.
+        duration time_to_next() const;
+
+#if SG_HAS_COROUTINES
+        struct sleep_awaiter;
+
+        // co_await in an sg::script suspends it for d
+        template <typename Rep, typename Period>
+        sleep_awaiter sleep(std::chrono::duration<Rep, Period> d);
+#endif
+
+    private:
+        static constexpr size_t levels = 4;
+        static constexpr size_t slot_bits = 8;
+        static constexpr size_t slots = size_t(1) << slot_bits;
+        static constexpr uint32_t nil = UINT32_MAX;
+
+        enum class state : uint8_t
+        {
+            free,
+            scheduled,
+            firing,
+            cancelled, // while firing
+        };
+
+        struct node
+        {
+            std::function<void ()> f;
+            uint64_t deadline;
+            uint64_t period;
+            uint64_t seq; // scheduling order, keeps each slot sorted
+            uint32_t prev;
+            uint32_t next; // next free node while free
+            uint32_t generation;
+            uint8_t level;
+            uint8_t slot;
+            state st;
+        };
+
+        struct list
+        {
+            uint32_t head;
+            uint32_t tail;
+        };
+
+        timer_id schedule(uint64_t delay, uint64_t period, std::function<void ()> f);
+        void insert(uint32_t i);
+        void unlink(uint32_t i);
+        void release(uint32_t i);
+        void cascade(size_t level);
+        void fire(uint32_t i);
+
+    private:
+        // a deque so that a running callback is not moved when another
+        // timer is scheduled
+        std::deque<node> nodes;
+        uint32_t free_head;
+        size_t count;
+        uint64_t now_;
+        uint64_t next_seq;
+        list wheel[levels][slots];
+    };
+
+#if SG_HAS_COROUTINES
+    // Coroutine driven by timers, for scripted behavior:
+    //
+    //     sg::script blink()
+    //     {
+    //         for (;;)
+    //         {
+    //             co_await ctx().sleep(0.5s);
+    //             visible = !visible;
+    //         }
+    //     }
+    //
+    // It runs up to its first co_await when called. Destroying the script
+    // object stops the coroutine and cancels the timer it waits on.
+    struct script
+    {
+        struct promise_type
+        {
+            script get_return_object()
+            {
+                return script(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {}
+
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+
+            timer_wheel* wheel = nullptr;
+            timer_wheel::timer_id waiting = timer_wheel::null_timer();
+        };
+
+        script()
+        {}
+
+        script(script&& other)
+            : handle(std::exchange(other.handle, nullptr))
+        {}
+
+        script& operator=(script&& other)
+        {
+            if (this != &other)
+            {
+                reset();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        ~script()
+        {
+            reset();
+        }
+
+        bool done() const
+        {
+            return !handle || handle.done();
+        }
+
+        void reset()
+        {
+            if (!handle)
+                return;
+
+            promise_type& p = handle.promise();
+            if (p.wheel)
+                p.wheel->cancel(p.waiting);
+            handle.destroy();
+            handle = nullptr;
+        }
+
+    private:
+        explicit script(std::coroutine_handle<promise_type> handle)
+            : handle(handle)
+        {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    struct timer_wheel::sleep_awaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<script::promise_type> h)
+        {
+            script::promise_type& p = h.promise();
+            p.wheel = wheel;
+            p.waiting = wheel->after(delay, [h]
+            {
+                h.promise().waiting = timer_wheel::null_timer();
+                h.resume();
+            });
+        }
+
+        void await_resume() const noexcept
+        {}
+
+        timer_wheel* wheel;
+        duration delay;
+    };
+
+    template <typename Rep, typename Period>
+    timer_wheel::sleep_awaiter timer_wheel::sleep(std::chrono::duration<Rep, Period> d)
+    {
+        return sleep_awaiter{this, std::chrono::ceil<duration>(d)};
+    }
+#endif
+}